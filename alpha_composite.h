@@ -0,0 +1,187 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Premultiplied ARGB32 copy of a frame, attached to its pixbuf so the draw path can paint it
+// directly. Returns an empty RefPtr for pixbufs that don't carry one yet.
+inline const Glib::Quark& frame_surface_quark() {
+    static const Glib::Quark quark("vs-spredit-frame-surface");
+    return quark;
+}
+
+inline std::mutex& frame_surface_mutex() {
+    static std::mutex mutex; // loader workers may reach the same cached pixbuf at once
+    return mutex;
+}
+
+inline Cairo::RefPtr<Cairo::ImageSurface> attached_surface(const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) {
+    if (!pixbuf)
+        return {};
+    std::lock_guard<std::mutex> lock(frame_surface_mutex());
+    auto* surface = static_cast<Cairo::RefPtr<Cairo::ImageSurface>*>(pixbuf->get_data(frame_surface_quark()));
+    return surface ? *surface : Cairo::RefPtr<Cairo::ImageSurface>();
+}
+
+// Attaches surface unless another thread got there first; returns whichever is attached
+inline Cairo::RefPtr<Cairo::ImageSurface> attach_surface(const Glib::RefPtr<Gdk::Pixbuf>& pixbuf, const Cairo::RefPtr<Cairo::ImageSurface>& surface) {
+    std::lock_guard<std::mutex> lock(frame_surface_mutex());
+    if (auto* existing = static_cast<Cairo::RefPtr<Cairo::ImageSurface>*>(pixbuf->get_data(frame_surface_quark())))
+        return *existing;
+    pixbuf->set_data(frame_surface_quark(), new Cairo::RefPtr<Cairo::ImageSurface>(surface),
+                     [](void* data) { delete static_cast<Cairo::RefPtr<Cairo::ImageSurface>*>(data); });
+    return surface;
+}
+
+// ARGB32 image surface in the layout that paints fastest onto target (e.g. shared memory for
+// X11); a plain image surface without a target or if the backend can't provide one.
+inline Cairo::RefPtr<Cairo::ImageSurface> create_similar_surface(const Cairo::RefPtr<Cairo::Surface>& target, int width, int height) {
+    if (target) {
+        cairo_surface_t* similar = cairo_surface_create_similar_image(target->cobj(), CAIRO_FORMAT_ARGB32, width, height);
+        if (cairo_surface_status(similar) == CAIRO_STATUS_SUCCESS)
+            return Cairo::RefPtr<Cairo::ImageSurface>(new Cairo::ImageSurface(similar, true));
+        cairo_surface_destroy(similar);
+    }
+    return Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, width, height);
+}
+
+namespace alpha_composite_detail {
+
+// Rec. 601 luma weights in 8.8 fixed point; they sum to 256 so white maps to exactly 255
+constexpr int luma_r = 77, luma_g = 150, luma_b = 29;
+
+inline uint8_t div255(unsigned v) {
+    v += 128;
+    return static_cast<uint8_t>((v + (v >> 8)) >> 8);
+}
+
+// One row into premultiplied native-endian ARGB32 (`argb`) and, if `rgba` is set, straight-alpha
+// RGBA. With a mask, its luma multiplies the colour's alpha; pixels without an alpha channel
+// (3 channels) count as opaque. Without a mask this is a plain premultiply.
+inline void composite_row(const guint8* color, int color_channels, const guint8* mask, int mask_channels,
+                          int width, guint8* rgba, uint32_t* argb) {
+    int x = 0;
+#if defined(__SSE2__)
+    // Two pixels per step, widened to 16 bits per channel. 3-channel rows are read 8 bytes at a
+    // time, so they stop one pixel early to stay inside the buffer and leave it to the scalar tail.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_set_epi16(0, luma_b, luma_g, luma_r, 0, luma_b, luma_g, luma_r);
+    const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    const __m128i round = _mm_set1_epi16(128);
+    auto load_pair = [&](const guint8* p, int channels) {
+        __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero);
+        if (channels == 3) // R0 G0 B0 R1 G1 B1 R2 G2 -> R0 G0 B0 R1 | R1 G1 B1 R2 (lane 3 is replaced below)
+            v = _mm_unpacklo_epi64(v, _mm_srli_si128(v, 6));
+        return v;
+    };
+    auto div255_16 = [&](__m128i v) {
+        v = _mm_add_epi16(v, round);
+        return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+    };
+    int limit = width - (color_channels == 3 || (mask && mask_channels == 3) ? 1 : 0);
+    for (; x + 2 <= limit; x += 2) {
+        __m128i c = load_pair(color + x * color_channels, color_channels);
+
+        // Alpha of each pixel, broadcast to all four of its lanes
+        __m128i a = _mm_set1_epi16(255);
+        if (mask) {
+            __m128i luma = _mm_madd_epi16(load_pair(mask + x * mask_channels, mask_channels), weights);
+            luma = _mm_add_epi32(luma, _mm_shuffle_epi32(luma, _MM_SHUFFLE(2, 3, 0, 1)));
+            luma = _mm_srli_epi32(_mm_add_epi32(luma, _mm_set1_epi32(128)), 8);
+            luma = _mm_packs_epi32(luma, luma);
+            a = _mm_unpacklo_epi16(luma, luma);
+        }
+        if (color_channels == 4) {
+            __m128i own = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, 0xFF), 0xFF);
+            a = mask ? div255_16(_mm_mullo_epi16(a, own)) : own;
+        }
+
+        __m128i premul = div255_16(_mm_mullo_epi16(c, a));
+        premul = _mm_or_si128(_mm_andnot_si128(alpha_lanes, premul), _mm_and_si128(alpha_lanes, a));
+        // RGBA -> BGRA, which is ARGB32 in memory on little-endian hosts (every SSE2 target)
+        premul = _mm_shufflehi_epi16(_mm_shufflelo_epi16(premul, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(argb + x), _mm_packus_epi16(premul, premul));
+
+        if (rgba) {
+            __m128i straight = _mm_or_si128(_mm_andnot_si128(alpha_lanes, c), _mm_and_si128(alpha_lanes, a));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(rgba + x * 4), _mm_packus_epi16(straight, straight));
+        }
+    }
+#endif
+    for (; x < width; ++x) {
+        const guint8* c = color + x * color_channels;
+        unsigned a = 255;
+        if (mask) {
+            const guint8* m = mask + x * mask_channels;
+            a = (m[0] * luma_r + m[1] * luma_g + m[2] * luma_b + 128) >> 8;
+        }
+        if (color_channels == 4)
+            a = mask ? div255(a * c[3]) : c[3];
+        argb[x] = (a << 24) | (uint32_t(div255(c[0] * a)) << 16) | (uint32_t(div255(c[1] * a)) << 8) | div255(c[2] * a);
+        if (rgba) {
+            guint8* out = rgba + x * 4;
+            out[0] = c[0];
+            out[1] = c[1];
+            out[2] = c[2];
+            out[3] = static_cast<guint8>(a);
+        }
+    }
+}
+
+} // namespace alpha_composite_detail
+
+// Applies a separate alpha mask image (its luminance becomes the alpha channel, multiplied with any
+// alpha the colour image already has) in one pass that writes both the straight-alpha RGBA pixbuf
+// the rest of the editor works with and the premultiplied ARGB32 surface Cairo paints. The surface
+// is attached to the returned pixbuf (see attached_surface). A mask of a different size is scaled
+// to the colour image first. Safe to call from worker threads.
+inline Glib::RefPtr<Gdk::Pixbuf> composite_alpha_mask(const Glib::RefPtr<Gdk::Pixbuf>& color, Glib::RefPtr<Gdk::Pixbuf> mask) {
+    int width = color->get_width();
+    int height = color->get_height();
+    if (mask->get_width() != width || mask->get_height() != height)
+        mask = mask->scale_simple(width, height, Gdk::INTERP_BILINEAR);
+
+    auto merged = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, width, height);
+    auto surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, width, height);
+    surface->flush();
+    const guint8* color_pixels = color->get_pixels();
+    const guint8* mask_pixels = mask->get_pixels();
+    guint8* merged_pixels = merged->get_pixels();
+    unsigned char* surface_pixels = surface->get_data();
+    for (int y = 0; y < height; ++y) {
+        alpha_composite_detail::composite_row(
+            color_pixels + static_cast<size_t>(y) * color->get_rowstride(), color->get_n_channels(),
+            mask_pixels + static_cast<size_t>(y) * mask->get_rowstride(), mask->get_n_channels(), width,
+            merged_pixels + static_cast<size_t>(y) * merged->get_rowstride(),
+            reinterpret_cast<uint32_t*>(surface_pixels + static_cast<size_t>(y) * surface->get_stride()));
+    }
+    surface->mark_dirty();
+    attach_surface(merged, surface);
+    return merged;
+}
+
+// The frame's premultiplied surface, converted and attached on first use. Loaders call this right
+// after decoding (on the worker, for async loads), so drawing never converts pixel formats.
+inline Cairo::RefPtr<Cairo::ImageSurface> premultiplied_surface_for(const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) {
+    if (!pixbuf)
+        return {};
+    if (auto surface = attached_surface(pixbuf))
+        return surface;
+
+    int width = pixbuf->get_width();
+    int height = pixbuf->get_height();
+    auto surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, width, height);
+    surface->flush();
+    const guint8* pixels = pixbuf->get_pixels();
+    unsigned char* surface_pixels = surface->get_data();
+    for (int y = 0; y < height; ++y) {
+        alpha_composite_detail::composite_row(
+            pixels + static_cast<size_t>(y) * pixbuf->get_rowstride(), pixbuf->get_n_channels(), nullptr, 0, width,
+            nullptr, reinterpret_cast<uint32_t*>(surface_pixels + static_cast<size_t>(y) * surface->get_stride()));
+    }
+    surface->mark_dirty();
+    return attach_surface(pixbuf, surface);
+}
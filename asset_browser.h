@@ -0,0 +1,254 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "asset_index.h"
+#include "frame_loader.h"
+#include "spr_parser.h"
+
+// Small previews of asset files, generated on FrameLoader workers and kept both in memory and as
+// PNGs under the user cache directory. Cache files are named by a hash of path, mtime and size,
+// so an edited asset gets a new thumbnail and the old one is simply never read again.
+class ThumbnailCache {
+public:
+    static constexpr int size = 48;
+    static constexpr size_t max_in_memory = 4096;
+
+    explicit ThumbnailCache(fs::path asset_root_dir, fs::path cache_dir = user_cache_dir() / "thumbnails",
+                            unsigned workers = 2)
+        : m_root(std::move(asset_root_dir)), m_dir(std::move(cache_dir)), m_loader(workers) {
+        std::error_code ec;
+        fs::create_directories(m_dir, ec);
+    }
+
+    using DeliverFn = std::function<void(const Glib::RefPtr<Gdk::Pixbuf>&)>;
+
+    // Calls `deliver` on the main loop with the thumbnail (nullptr if the file can't be previewed).
+    // Requests made before the last cancel_pending() that haven't started yet are dropped.
+    void request(const fs::path& path, DeliverFn deliver) {
+        auto it = m_memory.find(path.string());
+        if (it != m_memory.end()) {
+            m_recent.splice(m_recent.begin(), m_recent, it->second.recent_pos);
+            deliver(it->second.thumbnail);
+            return;
+        }
+        unsigned generation = m_generation;
+        m_loader.submit(
+            [this, path, generation]() -> Glib::RefPtr<Gdk::Pixbuf> {
+                if (generation != m_generation)
+                    return {};
+                return load_or_generate(path);
+            },
+            [this, path, generation, deliver](Glib::RefPtr<Gdk::Pixbuf> thumbnail) {
+                if (thumbnail)
+                    remember(path.string(), thumbnail);
+                if (generation == m_generation)
+                    deliver(thumbnail);
+            });
+    }
+
+    void cancel_pending() { ++m_generation; }
+
+private:
+    // Keeps the thumbnail in memory, dropping the least recently requested beyond max_in_memory
+    void remember(const std::string& key, const Glib::RefPtr<Gdk::Pixbuf>& thumbnail) {
+        auto it = m_memory.find(key);
+        if (it != m_memory.end()) {
+            it->second.thumbnail = thumbnail;
+            m_recent.splice(m_recent.begin(), m_recent, it->second.recent_pos);
+            return;
+        }
+        m_recent.push_front(key);
+        m_memory.emplace(key, Remembered{thumbnail, m_recent.begin()});
+        while (m_memory.size() > max_in_memory) {
+            m_memory.erase(m_recent.back());
+            m_recent.pop_back();
+        }
+    }
+
+    // Runs on a worker
+    Glib::RefPtr<Gdk::Pixbuf> load_or_generate(const fs::path& path) const {
+        std::error_code ec;
+        auto mtime = fs::last_write_time(path, ec);
+        auto bytes = fs::file_size(path, ec);
+        if (ec)
+            return {};
+        std::string key = path.string() + "\n" + std::to_string(mtime.time_since_epoch().count()) + "\n" +
+                          std::to_string(bytes);
+        fs::path cached = m_dir / (hex64(fnv1a64(key)) + ".png");
+        try {
+            if (fs::exists(cached, ec))
+                return Gdk::Pixbuf::create_from_file(cached.string());
+        } catch (const Glib::Error&) {
+            // unreadable cache file; regenerate it below
+        }
+
+        Glib::RefPtr<Gdk::Pixbuf> thumbnail;
+        try {
+            thumbnail = generate(path, m_root);
+        } catch (const Glib::Error&) {
+            return {};
+        }
+        if (!thumbnail)
+            return {};
+        fs::path temp = cached.string() + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        try {
+            thumbnail->save(temp.string(), "png");
+            fs::rename(temp, cached, ec);
+        } catch (const Glib::Error&) {
+            // still usable from memory
+        }
+        if (fs::exists(temp, ec))
+            fs::remove(temp, ec); // failed save or rename; don't leave it in the cache directory
+        return thumbnail;
+    }
+
+    // Sprites are previewed by the first frame, cropped but without its mask; the source image is
+    // read directly rather than through ImageCache so browsing doesn't evict the scene's images
+    static Glib::RefPtr<Gdk::Pixbuf> generate(const fs::path& path, const fs::path& asset_root_dir) {
+        if (is_dds_file(path))
+            return fit(load_dds(path.string(), size)); // the smallest embedded mip that covers a thumbnail
+        if (path.extension() != ".spr" && path.extension() != ".ani")
+            return fit(Gdk::Pixbuf::create_from_file(path.string(), size, size, true));
+
+        ImageItem item;
+        std::vector<ParsedFrameInfo> infos;
+        std::vector<SprDiagnostic> diagnostics; // a browser preview shouldn't log the sprite's problems
+        spr_diagnostic_sink = &diagnostics;
+        bool parsed = parse_spr_file(path.string(), asset_root_dir, item, infos);
+        spr_diagnostic_sink = nullptr;
+        if (!parsed || infos.empty())
+            return {};
+        const ParsedFrameInfo& info = infos.front();
+        auto image = load_image_file(info.image_path);
+        if (info.has_cropping) {
+            int w = image->get_width(), h = image->get_height();
+            int x = std::clamp(static_cast<int>(info.mins * w), 0, w - 1);
+            int y = std::clamp(static_cast<int>(info.mint * h), 0, h - 1);
+            int cw = std::clamp(static_cast<int>(info.maxs * w) - x, 1, w - x);
+            int ch = std::clamp(static_cast<int>(info.maxt * h) - y, 1, h - y);
+            image = Gdk::Pixbuf::create_subpixbuf(image, x, y, cw, ch);
+        }
+        return fit(image);
+    }
+
+    static Glib::RefPtr<Gdk::Pixbuf> fit(const Glib::RefPtr<Gdk::Pixbuf>& image) {
+        if (!image)
+            return {};
+        int w = image->get_width(), h = image->get_height();
+        if (w <= size && h <= size)
+            return image->copy();
+        double scale = std::min(double(size) / w, double(size) / h);
+        return image->scale_simple(std::max(1, int(w * scale)), std::max(1, int(h * scale)), Gdk::INTERP_BILINEAR);
+    }
+
+    fs::path m_root;
+    fs::path m_dir;
+    struct Remembered {
+        Glib::RefPtr<Gdk::Pixbuf> thumbnail;
+        std::list<std::string>::iterator recent_pos;
+    };
+    std::unordered_map<std::string, Remembered> m_memory; // main thread only
+    std::list<std::string> m_recent;                      // keys of m_memory, most recently used first
+    std::atomic<unsigned> m_generation{0};
+    FrameLoader m_loader;
+};
+
+// Searchable list of everything under the asset root. Typing filters the index with fuzzy_search;
+// activating a row (double click or Enter) emits signal_asset_activated with the file's full path.
+class AssetBrowser : public Gtk::Box {
+public:
+    static constexpr size_t max_results = 200;
+
+    explicit AssetBrowser(const fs::path& asset_root_dir)
+        : Gtk::Box(Gtk::ORIENTATION_VERTICAL), m_index(asset_root_dir), m_thumbnails(asset_root_dir) {
+        m_columns.add(m_thumbnail_column);
+        m_columns.add(m_name_column);
+        m_columns.add(m_path_column);
+        m_store = Gtk::ListStore::create(m_columns);
+        m_view.set_model(m_store);
+        m_view.set_headers_visible(false);
+        m_view.append_column("", m_thumbnail_column);
+        m_view.append_column("Asset", m_name_column);
+        m_view.signal_row_activated().connect(sigc::mem_fun(*this, &AssetBrowser::on_row_activated));
+        m_scroller.set_policy(Gtk::POLICY_NEVER, Gtk::POLICY_AUTOMATIC);
+        m_scroller.add(m_view);
+
+        m_search.set_placeholder_text("Search assets");
+        m_search.signal_search_changed().connect(sigc::mem_fun(*this, &AssetBrowser::update_results));
+        m_rescan.signal_clicked().connect(sigc::mem_fun(m_index, &AssetIndex::refresh));
+        m_index.signal_updated.connect(sigc::mem_fun(*this, &AssetBrowser::update_results));
+
+        m_header.pack_start(m_search);
+        m_header.pack_start(m_rescan, Gtk::PACK_SHRINK);
+        pack_start(m_header, Gtk::PACK_SHRINK);
+        pack_start(m_status, Gtk::PACK_SHRINK);
+        pack_start(m_scroller);
+        set_size_request(240, -1);
+
+        m_status.set_text("Indexing assets...");
+        m_index.refresh();
+    }
+
+    sigc::signal<void(const fs::path&)> signal_asset_activated;
+
+private:
+    void update_results() {
+        auto start = std::chrono::steady_clock::now();
+        auto matches = fuzzy_search(m_index.entries(), std::string(m_search.get_text()), max_results);
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        // Thumbnails still queued for the previous results are no longer wanted
+        m_thumbnails.cancel_pending();
+        unsigned generation = ++m_generation;
+        m_store->clear();
+        m_rows.clear();
+        for (const AssetEntry* entry : matches) {
+            auto row = m_store->append();
+            size_t slash = entry->path.rfind('/');
+            (*row)[m_name_column] = Glib::ustring(slash == std::string::npos ? entry->path : entry->path.substr(slash + 1));
+            (*row)[m_path_column] = entry->path;
+            m_rows.push_back(row);
+        }
+        for (size_t i = 0; i < matches.size(); ++i) {
+            m_thumbnails.request(m_index.root() / matches[i]->path,
+                [this, generation, i](const Glib::RefPtr<Gdk::Pixbuf>& thumbnail) {
+                    if (generation == m_generation && thumbnail)
+                        (*m_rows[i])[m_thumbnail_column] = thumbnail;
+                });
+        }
+
+        char text[128];
+        std::snprintf(text, sizeof(text), "%zu of %zu assets%s (%.1f ms)", matches.size(), m_index.entries().size(),
+                      m_index.scanning() ? ", indexing..." : "", ms);
+        m_status.set_text(text);
+    }
+
+    void on_row_activated(const Gtk::TreeModel::Path& path, Gtk::TreeViewColumn*) {
+        auto row = m_store->get_iter(path);
+        if (row)
+            signal_asset_activated.emit(m_index.root() / std::string((*row)[m_path_column]));
+    }
+
+    AssetIndex m_index;
+    ThumbnailCache m_thumbnails;
+    unsigned m_generation = 0;
+
+    Gtk::Box m_header{Gtk::ORIENTATION_HORIZONTAL};
+    Gtk::SearchEntry m_search;
+    Gtk::Button m_rescan{"Rescan"};
+    Gtk::Label m_status;
+    Gtk::ScrolledWindow m_scroller;
+    Gtk::TreeView m_view;
+    Gtk::TreeModelColumnRecord m_columns;
+    Gtk::TreeModelColumn<Glib::RefPtr<Gdk::Pixbuf>> m_thumbnail_column;
+    Gtk::TreeModelColumn<Glib::ustring> m_name_column;
+    Gtk::TreeModelColumn<std::string> m_path_column;
+    Glib::RefPtr<Gtk::ListStore> m_store;
+    std::vector<Gtk::TreeModel::iterator> m_rows;
+};
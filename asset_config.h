@@ -0,0 +1,63 @@
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Reads the asset root directory from the first line of the config file (vs_anim.cfg by default),
+// falling back to the built-in default when the file is missing or empty. Reports go to stderr,
+// so the command-line tools that call this keep stdout for their JSON.
+inline fs::path read_asset_root_dir(const std::string& CONFIG_FILE_NAME = "vs_anim.cfg") {
+    fs::path ASSET_ROOT_DIR;
+
+    std::ifstream config_file(CONFIG_FILE_NAME);
+    std::string root_dir_str;
+
+    if (config_file.is_open()) {
+        if (std::getline(config_file, root_dir_str)) {
+            // Trim whitespace from the loaded string
+            root_dir_str.erase(0, root_dir_str.find_first_not_of(" \t\n\r\f\v"));
+            root_dir_str.erase(root_dir_str.find_last_not_of(" \t\n\r\f\v") + 1);
+
+            if (!root_dir_str.empty()) {
+                ASSET_ROOT_DIR = root_dir_str;
+                std::cerr << "Loaded ASSET_ROOT_DIR from " << CONFIG_FILE_NAME << ": " << ASSET_ROOT_DIR << std::endl;
+            } else {
+                std::cerr << "Error: " << CONFIG_FILE_NAME << " is empty or contains only whitespace. Using default ASSET_ROOT_DIR." << std::endl;
+                ASSET_ROOT_DIR = "/home/james/Project/WCUniverse/"; // Default fallback
+            }
+        } else {
+            std::cerr << "Error: Could not read from " << CONFIG_FILE_NAME << ". Using default ASSET_ROOT_DIR." << std::endl;
+            ASSET_ROOT_DIR = "/home/james/Project/WCUniverse/"; // Default fallback
+        }
+        config_file.close();
+    } else {
+        std::cerr << "Error: Could not open " << CONFIG_FILE_NAME << ". Using default ASSET_ROOT_DIR." << std::endl;
+        ASSET_ROOT_DIR = "/home/james/Project/WCUniverse/"; // Default fallback
+    }
+
+    // Ensure the ASSET_ROOT_DIR exists and is a directory (optional, but good for robust error checking)
+    if (!fs::is_directory(ASSET_ROOT_DIR)) {
+        std::cerr << "Warning: ASSET_ROOT_DIR '" << ASSET_ROOT_DIR << "' is not a valid directory. Paths might fail." << std::endl;
+        // You might want to exit here if it's critical for your application
+        // return 1;
+    }
+    return ASSET_ROOT_DIR;
+}
+
+// Path as written into .spr/.ani files and layouts: relative to the asset root when the file lives
+// under it (that is how load_spr_file resolves relative paths), absolute otherwise.
+inline std::string asset_relative_path(const fs::path& file, const fs::path& asset_root_dir) {
+    std::error_code ec;
+    fs::path absolute = fs::weakly_canonical(file, ec);
+    if (ec) absolute = fs::absolute(file);
+    fs::path root = fs::weakly_canonical(asset_root_dir, ec);
+    if (!ec && !root.empty()) {
+        fs::path relative = absolute.lexically_relative(root);
+        if (!relative.empty() && *relative.begin() != "..")
+            return relative.generic_string();
+    }
+    return absolute.string();
+}
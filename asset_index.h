@@ -0,0 +1,355 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "asset_config.h"
+#include "atomic_file.h"
+#include "mapped_file.h"
+#include "spr_parser.h"
+
+// Per-user cache directory: $XDG_CACHE_HOME/vs_spredit, or ~/.cache/vs_spredit
+inline fs::path user_cache_dir() {
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg)
+        return fs::path(xdg) / "vs_spredit";
+    const char* home = std::getenv("HOME");
+    return (home && *home ? fs::path(home) / ".cache" : fs::temp_directory_path()) / "vs_spredit";
+}
+
+// Stable 64-bit FNV-1a, for cache file names that must survive restarts
+inline uint64_t fnv1a64(std::string_view s, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : s) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline std::string hex64(uint64_t v) {
+    static const char digits[] = "0123456789abcdef";
+    std::string s(16, '0');
+    for (int i = 15; i >= 0; --i, v >>= 4)
+        s[i] = digits[v & 0xf];
+    return s;
+}
+
+// Files the editor can place on the canvas
+inline bool is_asset_file(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext == ".spr" || ext == ".ani" || ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" ||
+           ext == ".dds";
+}
+
+struct AssetEntry {
+    std::string path; // relative to the asset root, '/'-separated
+    int64_t mtime = 0;
+    uint64_t size = 0;
+};
+
+// --- Fuzzy matching ---
+// `query` must already be lower case. Matches it as a subsequence of `text`, left to right.
+// Returns 0 if some character is missing, otherwise a score that rewards consecutive runs and
+// matches at the start of a word (after '/', '_', '-', '.', ' ' or a lower-to-upper case change).
+inline int fuzzy_subsequence_score(std::string_view query, std::string_view text) {
+    int score = 0;
+    size_t q = 0;
+    size_t previous = std::string_view::npos;
+    for (size_t i = 0; i < text.size() && q < query.size(); ++i) {
+        char c = static_cast<char>(std::tolower(static_cast<unsigned char>(text[i])));
+        if (c != query[q])
+            continue;
+        int s = 1;
+        if (previous != std::string_view::npos && previous + 1 == i)
+            s += 5;
+        char before = i ? text[i - 1] : '/';
+        if (before == '/' || before == '_' || before == '-' || before == '.' || before == ' ' ||
+            (std::islower(static_cast<unsigned char>(before)) && std::isupper(static_cast<unsigned char>(text[i]))))
+            s += 8;
+        score += s;
+        previous = i;
+        ++q;
+    }
+    return q == query.size() ? score : 0;
+}
+
+// Score of an asset path: a match inside the file name outranks one spread over directories, and
+// shorter paths win ties
+inline int fuzzy_score(std::string_view query, std::string_view path) {
+    int full = fuzzy_subsequence_score(query, path);
+    if (full == 0)
+        return 0;
+    size_t slash = path.rfind('/');
+    std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+    int in_name = fuzzy_subsequence_score(query, name);
+    int score = std::max(full, in_name ? in_name * 2 + 20 : 0);
+    return std::max(1, score * 16 - static_cast<int>(std::min<size_t>(path.size(), 255)) / 4);
+}
+
+// Best `limit` entries for `query` (case-insensitive), best first. An empty query lists the first
+// entries in path order.
+inline std::vector<const AssetEntry*> fuzzy_search(const std::vector<AssetEntry>& entries, std::string_view query,
+                                                   size_t limit) {
+    std::string q;
+    for (char c : query)
+        if (!is_space(c))
+            q += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    if (q.empty()) {
+        std::vector<const AssetEntry*> result;
+        for (size_t i = 0; i < std::min(limit, entries.size()); ++i)
+            result.push_back(&entries[i]);
+        return result;
+    }
+
+    std::vector<std::pair<int, const AssetEntry*>> matches;
+    for (const auto& entry : entries) {
+        int score = fuzzy_score(q, entry.path);
+        if (score > 0)
+            matches.emplace_back(score, &entry);
+    }
+    auto better = [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second->path < b.second->path;
+    };
+    size_t n = std::min(limit, matches.size());
+    std::partial_sort(matches.begin(), matches.begin() + n, matches.end(), better);
+    std::vector<const AssetEntry*> result;
+    for (size_t i = 0; i < n; ++i)
+        result.push_back(matches[i].second);
+    return result;
+}
+
+// --- Index ---
+// List of every asset under the asset root, built by a background scan and persisted in the user
+// cache directory so the next start has it immediately. Rescans are incremental: a directory whose
+// mtime hasn't changed since the last scan is not listed again (its files and subdirectories are
+// taken from the saved index; subdirectories are still visited). Files edited in place keep a
+// stale mtime in the index until their directory changes, so consumers that care (thumbnails)
+// stat the file themselves.
+//
+// Results are handed to the main loop through a Glib::Dispatcher; must be constructed on the main
+// thread, and entries() and signal_updated are only for the main thread.
+class AssetIndex {
+public:
+    explicit AssetIndex(fs::path asset_root_dir, fs::path cache_dir = user_cache_dir())
+        : m_root(std::move(asset_root_dir)),
+          m_index_path(cache_dir / ("index-" + hex64(fnv1a64(m_root.string())) + ".txt")) {
+        m_dispatcher.connect(sigc::mem_fun(*this, &AssetIndex::on_dispatch));
+    }
+
+    ~AssetIndex() {
+        m_stopping = true;
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    AssetIndex(const AssetIndex&) = delete;
+    AssetIndex& operator=(const AssetIndex&) = delete;
+
+    const fs::path& root() const { return m_root; }
+    const std::vector<AssetEntry>& entries() const { return m_entries; }
+    bool scanning() const { return m_scanning; }
+
+    // Emitted on the main loop when entries() changes: once from the saved index, again after the scan
+    sigc::signal<void()> signal_updated;
+
+    // Starts a background rescan unless one is running
+    void refresh() {
+        if (m_scanning)
+            return;
+        if (m_thread.joinable())
+            m_thread.join();
+        m_scanning = true;
+        m_thread = std::thread(&AssetIndex::scan, this);
+    }
+
+private:
+    struct Directory {
+        int64_t mtime = 0;
+        std::vector<AssetEntry> files; // file names only
+        std::vector<std::string> subdirs;
+    };
+    using DirectoryMap = std::map<std::string, Directory>; // keyed by relative path, "" for the root
+
+    static int64_t mtime_of(const fs::file_time_type& time) {
+        return static_cast<int64_t>(time.time_since_epoch().count());
+    }
+
+    static std::string join(const std::string& dir, const std::string& name) {
+        return dir.empty() ? name : dir + "/" + name;
+    }
+
+    // Saved format, one record per line (tab-separated; names containing tabs or newlines are
+    // not indexed):
+    //   vs_spredit asset index 1 \t <root>
+    //   D \t <mtime> \t <dir>      followed by that directory's
+    //   S \t <name>                subdirectories and
+    //   F \t <mtime> \t <size> \t <name>   asset files
+    bool load(DirectoryMap& dirs) const {
+        MappedFile file(m_index_path.string());
+        if (!file.is_open())
+            return false;
+        std::string_view contents = file.view(), line;
+        if (!next_line(contents, line) || line != "vs_spredit asset index 1\t" + m_root.string())
+            return false;
+        Directory* dir = nullptr;
+        while (next_line(contents, line)) {
+            std::vector<std::string_view> fields;
+            for (size_t start = 0;;) {
+                size_t tab = line.find('\t', start);
+                fields.push_back(line.substr(start, tab == std::string_view::npos ? tab : tab - start));
+                if (tab == std::string_view::npos) break;
+                start = tab + 1;
+            }
+            if (fields[0] == "D" && fields.size() == 3) {
+                dir = &dirs[std::string(fields[2])];
+                dir->mtime = std::strtoll(std::string(fields[1]).c_str(), nullptr, 10);
+            } else if (dir && fields[0] == "S" && fields.size() == 2) {
+                dir->subdirs.emplace_back(fields[1]);
+            } else if (dir && fields[0] == "F" && fields.size() == 4) {
+                AssetEntry& entry = dir->files.emplace_back();
+                entry.mtime = std::strtoll(std::string(fields[1]).c_str(), nullptr, 10);
+                entry.size = std::strtoull(std::string(fields[2]).c_str(), nullptr, 10);
+                entry.path = fields[3];
+            } else {
+                return false; // damaged; rescan from scratch
+            }
+        }
+        return true;
+    }
+
+    void save(const DirectoryMap& dirs) const {
+        std::error_code ec;
+        fs::create_directories(m_index_path.parent_path(), ec);
+        AtomicFileWriter writer(m_index_path, 1 << 20);
+        std::ostream& out = writer.stream();
+        out << "vs_spredit asset index 1\t" << m_root.string() << "\n";
+        for (const auto& [path, dir] : dirs) {
+            out << "D\t" << dir.mtime << "\t" << path << "\n";
+            for (const auto& sub : dir.subdirs)
+                out << "S\t" << sub << "\n";
+            for (const auto& file : dir.files)
+                out << "F\t" << file.mtime << "\t" << file.size << "\t" << file.path << "\n";
+        }
+        writer.commit();
+    }
+
+    static std::vector<AssetEntry> flatten(const DirectoryMap& dirs) {
+        std::vector<AssetEntry> entries;
+        for (const auto& [path, dir] : dirs) {
+            for (const auto& file : dir.files) {
+                AssetEntry& entry = entries.emplace_back(file);
+                entry.path = join(path, file.path);
+            }
+        }
+        std::sort(entries.begin(), entries.end(), [](const AssetEntry& a, const AssetEntry& b) { return a.path < b.path; });
+        return entries;
+    }
+
+    void publish(std::vector<AssetEntry> entries, bool done) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending = std::make_unique<std::vector<AssetEntry>>(std::move(entries));
+            m_pending_done = done;
+        }
+        m_dispatcher.emit();
+    }
+
+    void on_dispatch() {
+        std::unique_ptr<std::vector<AssetEntry>> pending;
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            pending.swap(m_pending);
+            done = m_pending_done;
+        }
+        if (!pending)
+            return;
+        m_entries = std::move(*pending);
+        if (done)
+            m_scanning = false;
+        signal_updated.emit();
+    }
+
+    // Runs on m_thread
+    void scan() {
+        auto start = std::chrono::steady_clock::now();
+        DirectoryMap saved;
+        if (load(saved) && !m_published_saved) {
+            m_published_saved = true; // only worth showing before the first scan has finished
+            publish(flatten(saved), false);
+        }
+
+        DirectoryMap current;
+        size_t listed = 0;
+        std::vector<std::string> stack{""};
+        while (!stack.empty() && !m_stopping) {
+            std::string rel = std::move(stack.back());
+            stack.pop_back();
+            fs::path abs = rel.empty() ? m_root : m_root / rel;
+            std::error_code ec;
+            auto mtime = fs::last_write_time(abs, ec);
+            if (ec)
+                continue;
+
+            Directory& dir = current[rel];
+            dir.mtime = mtime_of(mtime);
+            auto it = saved.find(rel);
+            if (it != saved.end() && it->second.mtime == dir.mtime) {
+                dir.files = std::move(it->second.files);
+                dir.subdirs = std::move(it->second.subdirs);
+            } else {
+                ++listed;
+                for (fs::directory_iterator d(abs, fs::directory_options::skip_permission_denied, ec), end;
+                     !ec && d != end; d.increment(ec)) {
+                    std::string name = d->path().filename().string();
+                    if (name.find_first_of("\t\n") != std::string::npos)
+                        continue;
+                    std::error_code entry_ec;
+                    // Symlinked directories are not followed, so links can't make the scan loop
+                    if (d->is_directory(entry_ec) && !d->is_symlink(entry_ec)) {
+                        dir.subdirs.push_back(name);
+                    } else if (is_asset_file(d->path()) && d->is_regular_file(entry_ec)) {
+                        AssetEntry& file = dir.files.emplace_back();
+                        file.path = name;
+                        file.mtime = mtime_of(d->last_write_time(entry_ec));
+                        file.size = d->file_size(entry_ec);
+                    }
+                }
+            }
+            for (const auto& sub : dir.subdirs)
+                stack.push_back(join(rel, sub));
+        }
+        if (m_stopping)
+            return;
+
+        save(current);
+        auto entries = flatten(current);
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Indexed " << entries.size() << " assets under " << m_root << " in " << ms << " ms (" << listed
+                  << " of " << current.size() << " directories listed)" << std::endl;
+        publish(std::move(entries), true);
+    }
+
+    fs::path m_root;
+    fs::path m_index_path;
+    std::vector<AssetEntry> m_entries;
+    bool m_scanning = false;
+    bool m_published_saved = false; // scan thread only
+    std::atomic<bool> m_stopping{false};
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::unique_ptr<std::vector<AssetEntry>> m_pending;
+    bool m_pending_done = false;
+    Glib::Dispatcher m_dispatcher;
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include "spr_parser.h"
+#include "frame_loader.h"
+#include "lazy_frame_store.h"
+
+using FrameReadyFn = std::function<void(const std::shared_ptr<ImageItem>&, size_t)>;
+
+// Decode step of load_spr_file_async for an item whose frame list is already known (parsed, or
+// restored from a scene snapshot). Returns nullptr if a static sprite's image can't be loaded.
+inline std::shared_ptr<ImageItem> start_frame_decodes(const std::shared_ptr<ImageItem>& item,
+                                                      const std::vector<ParsedFrameInfo>& parsed_frames_info,
+                                                      FrameLoader& loader, const FrameReadyFn& on_frame_ready) {
+    if (parsed_frames_info.empty())
+        return item;
+    if (!item->is_animation) {
+        try {
+            item->frames.push_back(decode_frame(parsed_frames_info.front()));
+        } catch (const Glib::Error& ex) {
+            spr_log(SprSeverity::Error, "missing_image") << "Cannot load static image file '" << item->static_image_filepath << "': " << ex.what();
+            return nullptr;
+        }
+        return item;
+    }
+
+    // Long animations keep only the frame list and decode within FrameBudget as they play
+    if (parsed_frames_info.size() > FrameBudget::instance().lazy_threshold_frames) {
+        std::weak_ptr<ImageItem> weak_item = item;
+        item->lazy_frames = std::make_shared<LazyFrameStore>(parsed_frames_info, &loader, [weak_item, on_frame_ready](size_t i) {
+            auto target = weak_item.lock();
+            if (!target)
+                return;
+            target->invalidate_scaled_cache(); // copies made from the stand-in frame
+            if (on_frame_ready)
+                on_frame_ready(target, i);
+        });
+        return item;
+    }
+
+    item->frames.assign(parsed_frames_info.size(), frame_placeholder());
+    std::weak_ptr<ImageItem> weak_item = item;
+    for (size_t i = 0; i < parsed_frames_info.size(); ++i) {
+        ParsedFrameInfo p_frame_info = parsed_frames_info[i];
+        loader.submit(
+            [weak_item, p_frame_info]() -> Glib::RefPtr<Gdk::Pixbuf> {
+                if (weak_item.expired())
+                    return {}; // item was removed before we got to it
+                try {
+                    return decode_frame(p_frame_info);
+                } catch (const Glib::Error& ex) {
+                    spr_log(SprSeverity::Error, "missing_frame") << "Cannot load animation frame '" << p_frame_info.image_path << "': " << ex.what();
+                    return {};
+                }
+            },
+            [weak_item, i, on_frame_ready](Glib::RefPtr<Gdk::Pixbuf> pixbuf) {
+                auto target = weak_item.lock();
+                if (!target || i >= target->frames.size())
+                    return;
+                target->frames[i] = pixbuf;
+                target->invalidate_scaled_cache();
+                if (on_frame_ready)
+                    on_frame_ready(target, i);
+            });
+    }
+    return item;
+}
+
+// --- Asynchronous variant: returns as soon as the file is parsed ---
+// Animation frames start out as a shared placeholder and are decoded on the loader's worker pool;
+// on_frame_ready runs on the main loop after each frame is swapped in. Static sprites are decoded
+// immediately so a missing image still fails the whole load, as in load_spr_file.
+// Animations longer than FrameBudget::lazy_threshold_frames get a LazyFrameStore instead.
+inline std::shared_ptr<ImageItem> load_spr_file_async(const std::string& filename, const fs::path& asset_root_dir,
+                                                      FrameLoader& loader, const FrameReadyFn& on_frame_ready) {
+    auto item = std::make_shared<ImageItem>();
+    std::vector<ParsedFrameInfo> parsed_frames_info;
+    if (!parse_spr_file(filename, asset_root_dir, *item, parsed_frames_info))
+        return nullptr;
+    return start_frame_decodes(item, parsed_frames_info, loader, on_frame_ready);
+}
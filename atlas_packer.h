@@ -0,0 +1,167 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <utility>
+#include <vector>
+
+// Bottom-left skyline packer for one fixed-size page. The skyline is the upper outline of what has
+// been placed so far; each rectangle goes where it ends lowest, ties broken by the narrower segment.
+class SkylinePacker {
+public:
+    SkylinePacker(int width, int height) : m_width(width), m_height(height), m_skyline{{0, 0, width}} {}
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    // Places a w x h rectangle; returns false (leaving the page unchanged) if it doesn't fit
+    bool insert(int w, int h, int& out_x, int& out_y) {
+        int best_index = -1, best_bottom = INT_MAX, best_segment_width = INT_MAX, best_y = 0;
+        for (size_t i = 0; i < m_skyline.size(); ++i) {
+            int y;
+            if (!fits(i, w, h, y))
+                continue;
+            if (y + h < best_bottom || (y + h == best_bottom && m_skyline[i].width < best_segment_width)) {
+                best_index = static_cast<int>(i);
+                best_bottom = y + h;
+                best_segment_width = m_skyline[i].width;
+                best_y = y;
+            }
+        }
+        if (best_index < 0)
+            return false;
+        out_x = m_skyline[best_index].x;
+        out_y = best_y;
+        add_segment(best_index, out_x, out_y + h, w);
+        return true;
+    }
+
+private:
+    struct Segment {
+        int x, y, width;
+    };
+
+    // Lowest y at which a w-wide rectangle starting at segment i rests on the skyline
+    bool fits(size_t i, int w, int h, int& y) const {
+        int x = m_skyline[i].x;
+        if (x + w > m_width)
+            return false;
+        y = m_skyline[i].y;
+        for (int width_left = w; width_left > 0; width_left -= m_skyline[i++].width) {
+            y = std::max(y, m_skyline[i].y);
+            if (y + h > m_height)
+                return false;
+        }
+        return true;
+    }
+
+    void add_segment(size_t index, int x, int y, int w) {
+        m_skyline.insert(m_skyline.begin() + index, Segment{x, y, w});
+        // Cut back the segments the new one now covers
+        for (size_t i = index + 1; i < m_skyline.size();) {
+            const Segment& prev = m_skyline[i - 1];
+            int overlap = prev.x + prev.width - m_skyline[i].x;
+            if (overlap <= 0)
+                break;
+            m_skyline[i].x += overlap;
+            m_skyline[i].width -= overlap;
+            if (m_skyline[i].width > 0)
+                break;
+            m_skyline.erase(m_skyline.begin() + i);
+        }
+        // Merge neighbours at the same height
+        for (size_t i = 0; i + 1 < m_skyline.size();) {
+            if (m_skyline[i].y == m_skyline[i + 1].y) {
+                m_skyline[i].width += m_skyline[i + 1].width;
+                m_skyline.erase(m_skyline.begin() + i + 1);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    int m_width, m_height;
+    std::vector<Segment> m_skyline;
+};
+
+struct AtlasPlacement {
+    int page = -1; // -1 if the rectangle is larger than max_page_size
+    int x = 0, y = 0;
+};
+
+struct AtlasLayout {
+    struct Page {
+        int width, height;
+    };
+    std::vector<Page> pages;
+    std::vector<AtlasPlacement> placements; // Parallel to the input sizes
+};
+
+inline int next_power_of_two(int v) {
+    int p = 1;
+    while (p < v)
+        p <<= 1;
+    return p;
+}
+
+// Packs rectangles (width, height) onto as few power-of-two pages as possible, each at most
+// max_page_size on a side. A page starts at the smallest power-of-two size that could hold what is
+// left and grows, alternating width and height, until everything fits or it reaches the maximum;
+// whatever still doesn't fit then starts the next page. `padding` pixels are kept free between
+// neighbouring rectangles (not along the page edges, so 2^n frames still fill a 2^n page).
+inline AtlasLayout pack_atlas(const std::vector<std::pair<int, int>>& sizes, int max_page_size = 4096, int padding = 1) {
+    AtlasLayout layout;
+    layout.placements.resize(sizes.size());
+
+    // Tallest first, then widest, is what keeps a skyline flat
+    std::vector<size_t> remaining;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        auto [w, h] = sizes[i];
+        if (w > 0 && h > 0 && w <= max_page_size && h <= max_page_size)
+            remaining.push_back(i);
+    }
+    std::sort(remaining.begin(), remaining.end(), [&](size_t a, size_t b) {
+        if (sizes[a].second != sizes[b].second) return sizes[a].second > sizes[b].second;
+        if (sizes[a].first != sizes[b].first) return sizes[a].first > sizes[b].first;
+        return a < b;
+    });
+
+    while (!remaining.empty()) {
+        long long area = 0;
+        int widest = 0, tallest = 0;
+        for (size_t i : remaining) {
+            area += static_cast<long long>(sizes[i].first + padding) * (sizes[i].second + padding);
+            widest = std::max(widest, sizes[i].first);
+            tallest = std::max(tallest, sizes[i].second);
+        }
+        int page_w = next_power_of_two(widest), page_h = next_power_of_two(tallest);
+        while (static_cast<long long>(page_w) * page_h < area && (page_w < max_page_size || page_h < max_page_size)) {
+            if ((page_w <= page_h && page_w < max_page_size) || page_h >= max_page_size) page_w *= 2;
+            else page_h *= 2;
+        }
+
+        int page_index = static_cast<int>(layout.pages.size());
+        std::vector<size_t> left_over;
+        for (;;) {
+            // Rectangles are packed with their padding, so the page gets the same slack at its far edges
+            SkylinePacker packer(page_w + padding, page_h + padding);
+            left_over.clear();
+            for (size_t i : remaining) {
+                AtlasPlacement& p = layout.placements[i];
+                if (packer.insert(sizes[i].first + padding, sizes[i].second + padding, p.x, p.y))
+                    p.page = page_index;
+                else
+                    left_over.push_back(i);
+            }
+            bool at_max = page_w >= max_page_size && page_h >= max_page_size;
+            if (left_over.empty() || at_max)
+                break;
+            if ((page_w <= page_h && page_w < max_page_size) || page_h >= max_page_size) page_w *= 2;
+            else page_h *= 2;
+        }
+        for (size_t i : left_over)
+            layout.placements[i].page = -1;
+        layout.pages.push_back({page_w, page_h});
+        remaining.swap(left_over);
+    }
+    return layout;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <locale>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Buffered writer that replaces a file atomically: output goes to a temporary file in the same
+// directory, which commit() flushes, fsyncs and renames over the target. Until then the old file
+// is untouched, and a writer destroyed without committing (error, exception, crash) removes its
+// temporary file, so readers only ever see the complete old or the complete new contents.
+// The stream uses the classic "C" locale, so numbers are written the way the parsers read them.
+class AtomicFileWriter : private std::streambuf {
+public:
+    explicit AtomicFileWriter(const fs::path& path, size_t buffer_size = 64 * 1024)
+        : m_path(path), m_buffer(buffer_size), m_stream(this) {
+        m_stream.imbue(std::locale::classic());
+        m_temp_path = path.string() + ".tmp-XXXXXX";
+        m_fd = ::mkstemp(m_temp_path.data());
+        if (m_fd < 0) {
+            fail("cannot create temporary file");
+            m_temp_path.clear();
+            return;
+        }
+        // mkstemp creates 0600; keep the mode of the file being replaced, or the usual 0644
+        struct stat st;
+        mode_t mode = ::stat(path.c_str(), &st) == 0 ? (st.st_mode & 07777) : 0644;
+        ::fchmod(m_fd, mode);
+        setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+    }
+
+    ~AtomicFileWriter() override {
+        if (m_fd >= 0)
+            ::close(m_fd);
+        if (!m_committed && !m_temp_path.empty())
+            ::unlink(m_temp_path.c_str());
+    }
+
+    AtomicFileWriter(const AtomicFileWriter&) = delete;
+    AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+
+    std::ostream& stream() { return m_stream; }
+    bool ok() const { return !m_failed; }
+
+    // Makes the new contents visible under the target path. Returns false (and leaves the old file
+    // in place) if anything failed along the way.
+    bool commit() {
+        if (m_failed || m_fd < 0)
+            return false;
+        if (!flush_buffer())
+            return false;
+        if (::fsync(m_fd) != 0)
+            return fail("fsync failed");
+        if (::close(m_fd) != 0) {
+            m_fd = -1;
+            return fail("close failed");
+        }
+        m_fd = -1;
+        if (::rename(m_temp_path.c_str(), m_path.c_str()) != 0)
+            return fail("rename failed");
+        m_committed = true;
+        // Persist the rename itself; failing here doesn't undo it, so it is not an error
+        fs::path dir = m_path.parent_path().empty() ? fs::path(".") : m_path.parent_path();
+        int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd >= 0) {
+            ::fsync(dir_fd);
+            ::close(dir_fd);
+        }
+        return true;
+    }
+
+private:
+    int overflow(int ch) override {
+        if (!flush_buffer())
+            return traits_type::eof();
+        if (ch != traits_type::eof()) {
+            *pptr() = static_cast<char>(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        return flush_buffer() ? 0 : -1;
+    }
+
+    bool flush_buffer() {
+        if (m_failed)
+            return false;
+        const char* data = pbase();
+        size_t size = static_cast<size_t>(pptr() - pbase());
+        while (size > 0) {
+            ssize_t written = ::write(m_fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return fail("write failed");
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+        return true;
+    }
+
+    bool fail(const char* what) {
+        if (!m_failed)
+            std::cerr << "Error: " << what << " while saving " << m_path << ": " << std::strerror(errno) << std::endl;
+        m_failed = true;
+        m_stream.setstate(std::ios::badbit);
+        return false;
+    }
+
+    fs::path m_path;
+    std::string m_temp_path;
+    int m_fd = -1;
+    bool m_failed = false;
+    bool m_committed = false;
+    std::vector<char> m_buffer;
+    std::ostream m_stream;
+};
@@ -0,0 +1,308 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "alpha_composite.h"
+#include "mapped_file.h"
+#include "mip_pyramid.h"
+
+namespace fs = std::filesystem;
+
+// Reader for DirectDraw Surface textures compressed as BC1 (DXT1) or BC3 (DXT5), the formats
+// Vega Strike ships most of its art in. The file is memory-mapped and decoded straight into a
+// straight-alpha RGBA pixbuf plus its premultiplied surface, in one pass per row of 4x4 blocks
+// (the premultiply is composite_row's SSE2 kernel). Large textures are split across threads by
+// block rows. Smaller mip levels stored in the file are kept compressed and decoded only when a
+// zoomed-out view asks the frame's MipPyramid for them.
+
+namespace dds_detail {
+
+enum class Format { BC1, BC3 };
+
+struct Level {
+    size_t offset = 0;
+    int width = 0, height = 0;
+};
+
+struct Info {
+    Format format = Format::BC1;
+    std::vector<Level> levels; // largest first
+};
+
+inline uint32_t read_u32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v; // DDS is little-endian, as is every host this editor runs on
+}
+
+constexpr uint32_t fourcc(char a, char b, char c, char d) {
+    return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+}
+
+inline size_t block_bytes(Format format) { return format == Format::BC1 ? 8 : 16; }
+
+inline size_t level_bytes(Format format, int width, int height) {
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * block_bytes(format);
+}
+
+// Parses the header and locates every mip level present in full. Returns an error message, or
+// an empty string on success.
+inline std::string parse_header(std::string_view file, Info& info) {
+    constexpr size_t header_end = 4 + 124;
+    if (file.size() < header_end || file.substr(0, 4) != "DDS ")
+        return "not a DDS file";
+    const char* h = file.data() + 4;
+    if (read_u32(h) != 124)
+        return "bad DDS header size";
+    int height = static_cast<int>(read_u32(h + 8));
+    int width = static_cast<int>(read_u32(h + 12));
+    uint32_t mip_count = read_u32(h + 24);
+    uint32_t pixel_flags = read_u32(h + 76);
+    uint32_t code = read_u32(h + 80);
+    if (width <= 0 || height <= 0 || width > (1 << 16) || height > (1 << 16))
+        return "bad DDS dimensions";
+    if (!(pixel_flags & 0x4)) // DDPF_FOURCC
+        return "uncompressed DDS is not supported";
+
+    size_t offset = header_end;
+    if (code == fourcc('D', 'X', 'T', '1')) {
+        info.format = Format::BC1;
+    } else if (code == fourcc('D', 'X', 'T', '5')) {
+        info.format = Format::BC3;
+    } else if (code == fourcc('D', 'X', '1', '0')) {
+        if (file.size() < header_end + 20)
+            return "truncated DX10 header";
+        uint32_t dxgi = read_u32(file.data() + header_end);
+        if (dxgi >= 70 && dxgi <= 72)       // BC1_TYPELESS, BC1_UNORM, BC1_UNORM_SRGB
+            info.format = Format::BC1;
+        else if (dxgi >= 76 && dxgi <= 78)  // BC3_TYPELESS, BC3_UNORM, BC3_UNORM_SRGB
+            info.format = Format::BC3;
+        else
+            return "unsupported DXGI format " + std::to_string(dxgi);
+        offset += 20;
+    } else {
+        return "unsupported compression (only DXT1/BC1 and DXT5/BC3)";
+    }
+
+    info.levels.clear();
+    for (uint32_t i = 0; i < std::max<uint32_t>(mip_count, 1) && i < 17; ++i) {
+        Level level{offset, std::max(1, width >> i), std::max(1, height >> i)};
+        size_t bytes = level_bytes(info.format, level.width, level.height);
+        if (offset + bytes > file.size())
+            break; // a truncated mip chain still leaves the levels before it usable
+        info.levels.push_back(level);
+        offset += bytes;
+        if (level.width == 1 && level.height == 1)
+            break;
+    }
+    if (info.levels.empty())
+        return "truncated DDS pixel data";
+    return {};
+}
+
+// 5:6:5 colour to RGBA packed as it lies in memory (R in the low byte)
+inline uint32_t expand_565(uint16_t c) {
+    uint32_t r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    return (r << 3 | r >> 2) | (g << 2 | g >> 4) << 8 | (b << 3 | b >> 2) << 16 | 0xFF000000u;
+}
+
+inline uint32_t mix(uint32_t a, uint32_t b, unsigned wa, unsigned wb, unsigned div) {
+    uint32_t out = 0xFF000000u;
+    for (int shift = 0; shift < 24; shift += 8)
+        out |= (((a >> shift & 0xFF) * wa + (b >> shift & 0xFF) * wb) / div) << shift;
+    return out;
+}
+
+// The 16 texels of a BC1 colour block, row-major. BC3 colour blocks never use the 3-colour mode
+// with transparent black, so `bc1` selects it only where the endpoints ask for it.
+inline void decode_color_block(const uint8_t* block, bool bc1, uint32_t texels[16]) {
+    uint16_t c0 = uint16_t(block[0] | block[1] << 8), c1 = uint16_t(block[2] | block[3] << 8);
+    uint32_t palette[4];
+    palette[0] = expand_565(c0);
+    palette[1] = expand_565(c1);
+    if (c0 > c1 || !bc1) {
+        palette[2] = mix(palette[0], palette[1], 2, 1, 3);
+        palette[3] = mix(palette[0], palette[1], 1, 2, 3);
+    } else {
+        palette[2] = mix(palette[0], palette[1], 1, 1, 2);
+        palette[3] = 0;
+    }
+    uint32_t indices = uint32_t(block[4]) | uint32_t(block[5]) << 8 | uint32_t(block[6]) << 16 | uint32_t(block[7]) << 24;
+    for (int i = 0; i < 16; ++i)
+        texels[i] = palette[(indices >> (2 * i)) & 3];
+}
+
+// Replaces the alpha of 16 texels with a BC3 alpha block
+inline void apply_alpha_block(const uint8_t* block, uint32_t texels[16]) {
+    unsigned a0 = block[0], a1 = block[1];
+    uint32_t alpha[8] = {a0, a1};
+    if (a0 > a1) {
+        for (unsigned i = 1; i < 7; ++i)
+            alpha[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    } else {
+        for (unsigned i = 1; i < 5; ++i)
+            alpha[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        alpha[6] = 0;
+        alpha[7] = 255;
+    }
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i)
+        indices |= uint64_t(block[2 + i]) << (8 * i);
+    for (int i = 0; i < 16; ++i)
+        texels[i] = (texels[i] & 0x00FFFFFFu) | alpha[(indices >> (3 * i)) & 7] << 24;
+}
+
+// Decodes block rows [first, last) of a level into RGBA rows (rgba, rgba_stride) and, if argb is
+// set, premultiplied ARGB32 rows as well
+inline void decode_block_rows(const uint8_t* data, Format format, int width, int height, int first, int last,
+                              guint8* rgba, int rgba_stride, guint8* argb, int argb_stride) {
+    const int blocks_wide = (width + 3) / 4;
+    const size_t stride = block_bytes(format);
+    uint32_t texels[16];
+    for (int by = first; by < last; ++by) {
+        const uint8_t* block = data + static_cast<size_t>(by) * blocks_wide * stride;
+        int rows = std::min(4, height - 4 * by);
+        for (int bx = 0; bx < blocks_wide; ++bx, block += stride) {
+            if (format == Format::BC3) {
+                decode_color_block(block + 8, false, texels);
+                apply_alpha_block(block, texels);
+            } else {
+                decode_color_block(block, true, texels);
+            }
+            int columns = std::min(4, width - 4 * bx);
+            for (int y = 0; y < rows; ++y) {
+                guint8* out = rgba + static_cast<size_t>(4 * by + y) * rgba_stride + 16 * bx;
+                std::memcpy(out, texels + 4 * y, 4 * columns);
+            }
+        }
+        // Premultiply the four rows just written while they are still in cache
+        for (int y = 0; argb && y < rows; ++y) {
+            size_t row = static_cast<size_t>(4 * by + y);
+            alpha_composite_detail::composite_row(rgba + row * rgba_stride, 4, nullptr, 0, width, nullptr,
+                                                  reinterpret_cast<uint32_t*>(argb + row * argb_stride));
+        }
+    }
+}
+
+// Decodes a whole level, splitting it across threads when it is large enough to be worth it
+inline void decode_level(const uint8_t* data, Format format, int width, int height, guint8* rgba, int rgba_stride,
+                         guint8* argb, int argb_stride) {
+    const int block_rows = (height + 3) / 4;
+    constexpr int rows_per_task = 16; // 64 pixel rows
+    unsigned threads = 1;
+    if (static_cast<size_t>(width) * height >= 512 * 512)
+        threads = std::min<unsigned>({std::max(1u, std::thread::hardware_concurrency()), 8u,
+                                      static_cast<unsigned>((block_rows + rows_per_task - 1) / rows_per_task)});
+    if (threads <= 1) {
+        decode_block_rows(data, format, width, height, 0, block_rows, rgba, rgba_stride, argb, argb_stride);
+        return;
+    }
+    std::atomic<int> next{0};
+    auto worker = [&] {
+        for (int first = next.fetch_add(rows_per_task); first < block_rows; first = next.fetch_add(rows_per_task))
+            decode_block_rows(data, format, width, height, first, std::min(block_rows, first + rows_per_task), rgba,
+                              rgba_stride, argb, argb_stride);
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; ++i)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool)
+        t.join();
+}
+
+// The file's smaller levels, offered to the frame's MipPyramid. Their compressed blocks are copied
+// out of the mapping (at most a third of level 0), so an editor rewriting the file in place can't
+// pull pages out from under a later decode.
+class DdsMips : public EmbeddedMips {
+public:
+    // Copies levels 1 and up of `info` from `file`
+    DdsMips(const MappedFile& file, Info info) : m_info(std::move(info)) {
+        for (size_t i = 1; i < m_info.levels.size(); ++i) {
+            Level& level = m_info.levels[i];
+            size_t bytes = level_bytes(m_info.format, level.width, level.height);
+            const uint8_t* src = reinterpret_cast<const uint8_t*>(file.data() + level.offset);
+            level.offset = m_blocks.size();
+            m_blocks.insert(m_blocks.end(), src, src + bytes);
+        }
+    }
+
+    size_t count() const override { return m_info.levels.size(); }
+
+    Cairo::RefPtr<Cairo::ImageSurface> level(size_t index) const override {
+        if (index == 0 || index >= m_info.levels.size())
+            return {}; // level 0 is the frame itself
+        const Level& level = m_info.levels[index];
+        int rgba_stride = 4 * level.width;
+        std::vector<guint8> rgba(static_cast<size_t>(rgba_stride) * level.height);
+        auto surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, level.width, level.height);
+        surface->flush();
+        decode_level(m_blocks.data() + level.offset, m_info.format, level.width,
+                     level.height, rgba.data(), rgba_stride, surface->get_data(), surface->get_stride());
+        surface->mark_dirty();
+        return surface;
+    }
+
+private:
+    Info m_info;                  // offsets of levels 1 and up are into m_blocks
+    std::vector<uint8_t> m_blocks;
+};
+
+[[noreturn]] inline void fail(const std::string& path, const std::string& message) {
+    throw Gdk::PixbufError(Gdk::PixbufError::CORRUPT_IMAGE, "Cannot load " + path + ": " + message);
+}
+
+} // namespace dds_detail
+
+// Loads the largest mip level of a BC1/BC3 .dds file, or with min_size > 0 the smallest level
+// still at least min_size pixels in both dimensions (for previews). The premultiplied surface is
+// attached, as composite_alpha_mask does, and so are the smaller levels when the file has them.
+// Throws Glib::Error like Gdk::Pixbuf::create_from_file. Safe to call from worker threads.
+inline Glib::RefPtr<Gdk::Pixbuf> load_dds(const std::string& path, int min_size = 0) {
+    using namespace dds_detail;
+    MappedFile file(path);
+    if (!file.is_open())
+        fail(path, "cannot open file");
+    Info info;
+    std::string error = parse_header(file.view(), info);
+    if (!error.empty())
+        fail(path, error);
+
+    size_t first = 0;
+    while (min_size > 0 && first + 1 < info.levels.size() && info.levels[first + 1].width >= min_size &&
+           info.levels[first + 1].height >= min_size)
+        ++first;
+    info.levels.erase(info.levels.begin(), info.levels.begin() + first);
+    const Level& top = info.levels.front();
+
+    auto pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, top.width, top.height);
+    auto surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, top.width, top.height);
+    surface->flush();
+    decode_level(reinterpret_cast<const uint8_t*>(file.data() + top.offset), info.format, top.width, top.height,
+                 pixbuf->get_pixels(), pixbuf->get_rowstride(), surface->get_data(), surface->get_stride());
+    surface->mark_dirty();
+    attach_surface(pixbuf, surface);
+    if (info.levels.size() > 1)
+        attach_embedded_mips(pixbuf, std::make_shared<DdsMips>(file, std::move(info)));
+    return pixbuf;
+}
+
+inline bool is_dds_file(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext == ".dds";
+}
+
+// Gdk::Pixbuf::create_from_file, plus the DDS textures gdk-pixbuf has no loader for
+inline Glib::RefPtr<Gdk::Pixbuf> load_image_file(const fs::path& path) {
+    if (is_dds_file(path))
+        return load_dds(path.string());
+    return Gdk::Pixbuf::create_from_file(path.string());
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "scene_renderer.h"
+#include "viewport.h"
+
+// Flattened copies of the scene below and above an item being dragged, in widget pixels, so each
+// motion event composites three layers (below, the item, above) instead of repainting every item
+// the item passes over. The layers belong to one item, viewport and widget size; anything else
+// means rebuilding them. Items inside them that change (an animation frame, a reload) are
+// repainted into both layers over just their damaged box before the next composite.
+class DragLayers {
+public:
+    bool valid_for(const ImageItem* moving, const Viewport& view, int scale_factor) const {
+        return m_below && m_moving == moving && m_scale_factor == scale_factor && m_view.zoom == view.zoom &&
+               m_view.pan_x == view.pan_x && m_view.pan_y == view.pan_y && m_view.width == view.width &&
+               m_view.height == view.height;
+    }
+
+    // Renders `below` and `above` (each in paint order) over the whole widget
+    void build(const Cairo::RefPtr<Cairo::Surface>& target, const ImageItem* moving, const Viewport& view, int scale_factor,
+               const std::vector<std::shared_ptr<ImageItem>>& below, const std::vector<std::shared_ptr<ImageItem>>& above) {
+        m_moving = moving;
+        m_view = view;
+        m_scale_factor = scale_factor;
+        m_dirty.clear();
+        int w = std::max(1, static_cast<int>(std::ceil(view.width))) * scale_factor;
+        int h = std::max(1, static_cast<int>(std::ceil(view.height))) * scale_factor;
+        m_below = create_similar_surface(target, w, h);
+        m_above = create_similar_surface(target, w, h);
+        m_below->set_device_scale(scale_factor, scale_factor);
+        m_above->set_device_scale(scale_factor, scale_factor);
+        render(m_below, below, view.visible_canvas());
+        render(m_above, above, view.visible_canvas());
+    }
+
+    void reset() {
+        m_below.clear();
+        m_above.clear();
+        m_moving = nullptr;
+        m_dirty.clear();
+    }
+
+    // Canvas-space box whose contents changed under or over the moving item
+    void mark_dirty(const ItemBounds& b) {
+        if (m_below && !b.empty())
+            m_dirty.push_back(b);
+    }
+
+    const std::vector<ItemBounds>& dirty() const { return m_dirty; }
+
+    // Repaints one dirty box of each layer from the items overlapping it; call for every box in
+    // dirty() (items found through the caller's spatial index), then clear_dirty()
+    void refresh(const ItemBounds& b, const std::vector<std::shared_ptr<ImageItem>>& below,
+                 const std::vector<std::shared_ptr<ImageItem>>& above) {
+        render(m_below, below, b);
+        render(m_above, above, b);
+    }
+
+    void clear_dirty() { m_dirty.clear(); }
+
+    // Composites the layers around `moving` onto cr, whose user space is canvas space through
+    // this viewport and whose widget-space matrix is `widget_matrix`
+    void paint(const Cairo::RefPtr<Cairo::Context>& cr, const Cairo::Matrix& widget_matrix,
+               const std::shared_ptr<ImageItem>& moving) const {
+        paint_layer(cr, widget_matrix, m_below);
+        draw_items(cr, {moving}, m_view.zoom);
+        paint_layer(cr, widget_matrix, m_above);
+    }
+
+private:
+    // Clears box b (canvas units, padded for anti-aliased edges) of layer and repaints the items there
+    void render(const Cairo::RefPtr<Cairo::ImageSurface>& layer, const std::vector<std::shared_ptr<ImageItem>>& items,
+                const ItemBounds& b) const {
+        auto cr = Cairo::Context::create(layer);
+        m_view.apply(cr);
+        double pad = 1.0 / m_view.zoom;
+        cr->rectangle(b.left - pad, b.top - pad, b.width + 2 * pad, b.height + 2 * pad);
+        cr->clip();
+        cr->set_operator(Cairo::OPERATOR_CLEAR);
+        cr->paint();
+        cr->set_operator(Cairo::OPERATOR_OVER);
+        draw_items(cr, items, m_view.zoom);
+    }
+
+    static void paint_layer(const Cairo::RefPtr<Cairo::Context>& cr, const Cairo::Matrix& widget_matrix,
+                            const Cairo::RefPtr<Cairo::ImageSurface>& layer) {
+        cr->save();
+        cr->set_matrix(widget_matrix);
+        cr->set_source(layer, 0, 0);
+        cr->paint();
+        cr->restore();
+    }
+
+    const ImageItem* m_moving = nullptr;
+    Viewport m_view;
+    int m_scale_factor = 1;
+    Cairo::RefPtr<Cairo::ImageSurface> m_below, m_above;
+    std::vector<ItemBounds> m_dirty;
+};
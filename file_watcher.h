@@ -0,0 +1,144 @@
+#pragma once
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <set>
+
+namespace fs = std::filesystem;
+
+// Path form used to compare watched files with inotify events: absolute, with symlinked
+// directories and ".." resolved as far as the file system allows
+inline fs::path watch_key(const fs::path& path) {
+    std::error_code ec;
+    fs::path key = fs::weakly_canonical(path, ec);
+    return ec ? fs::absolute(path) : key;
+}
+
+// Watches a set of files through inotify on the GTK main loop and reports changes in batches:
+// events are collected until none has arrived for debounce_ms, then signal_changed is emitted
+// once with every watched file that changed (as watch_key paths).
+//
+// The directories are watched rather than the files, since editors and paint tools usually save
+// by writing a new file and renaming it over the old one, which would silently end a watch on the
+// file itself. A file counts as changed when it is closed after writing or renamed into place.
+class FileWatcher {
+public:
+    explicit FileWatcher(unsigned debounce_ms = 200) : m_debounce_ms(debounce_ms) {
+        m_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd < 0) {
+            std::cerr << "Warning: inotify unavailable (" << std::strerror(errno) << "); files won't be reloaded on change." << std::endl;
+            return;
+        }
+        m_io = Glib::signal_io().connect(sigc::mem_fun(*this, &FileWatcher::on_io), m_fd, Glib::IO_IN);
+    }
+
+    ~FileWatcher() {
+        m_io.disconnect();
+        m_timer.disconnect();
+        if (m_fd >= 0)
+            ::close(m_fd);
+    }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    sigc::signal<void(const std::set<fs::path>&)> signal_changed;
+
+    // Replaces the watched set. Paths are converted with watch_key.
+    void watch(const std::set<fs::path>& files) {
+        if (m_fd < 0)
+            return;
+        m_files.clear();
+        std::set<fs::path> dirs;
+        for (const auto& file : files) {
+            fs::path key = watch_key(file);
+            m_files.insert(key);
+            dirs.insert(key.parent_path());
+        }
+
+        for (auto it = m_wd_by_dir.begin(); it != m_wd_by_dir.end();) {
+            if (dirs.count(it->first)) {
+                ++it;
+                continue;
+            }
+            ::inotify_rm_watch(m_fd, it->second);
+            m_dir_by_wd.erase(it->second);
+            it = m_wd_by_dir.erase(it);
+        }
+        for (const auto& dir : dirs) {
+            if (m_wd_by_dir.count(dir))
+                continue;
+            int wd = ::inotify_add_watch(m_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+            if (wd < 0) {
+                std::cerr << "Warning: cannot watch " << dir << ": " << std::strerror(errno) << std::endl;
+                continue;
+            }
+            m_wd_by_dir[dir] = wd;
+            m_dir_by_wd[wd] = dir;
+        }
+    }
+
+    size_t watched_file_count() const { return m_files.size(); }
+
+private:
+    bool on_io(Glib::IOCondition) {
+        alignas(inotify_event) char buffer[16 * 1024];
+        while (true) {
+            ssize_t length = ::read(m_fd, buffer, sizeof(buffer));
+            if (length < 0 && errno == EINTR)
+                continue;
+            if (length <= 0)
+                break; // EAGAIN: queue drained
+            for (ssize_t offset = 0; offset < length;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    m_pending.insert(m_files.begin(), m_files.end()); // lost track; assume everything changed
+                    continue;
+                }
+                if (event->mask & IN_IGNORED) {
+                    // Directory removed or unmounted; the watch is gone
+                    auto dir = m_dir_by_wd.find(event->wd);
+                    if (dir != m_dir_by_wd.end()) {
+                        m_wd_by_dir.erase(dir->second);
+                        m_dir_by_wd.erase(dir);
+                    }
+                    continue;
+                }
+                auto dir = m_dir_by_wd.find(event->wd);
+                if (dir == m_dir_by_wd.end() || event->len == 0)
+                    continue;
+                fs::path path = dir->second / event->name;
+                if (m_files.count(path))
+                    m_pending.insert(path);
+            }
+        }
+
+        if (!m_pending.empty()) {
+            // Restart the quiet period: a multi-file export settles into one batch
+            m_timer.disconnect();
+            m_timer = Glib::signal_timeout().connect(sigc::mem_fun(*this, &FileWatcher::on_settled), m_debounce_ms);
+        }
+        return true;
+    }
+
+    bool on_settled() {
+        std::set<fs::path> changed;
+        changed.swap(m_pending);
+        signal_changed.emit(changed);
+        return false;
+    }
+
+    int m_fd = -1;
+    unsigned m_debounce_ms;
+    sigc::connection m_io;
+    sigc::connection m_timer;
+    std::set<fs::path> m_files;
+    std::set<fs::path> m_pending;
+    std::map<fs::path, int> m_wd_by_dir;
+    std::map<int, fs::path> m_dir_by_wd;
+};
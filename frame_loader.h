@@ -0,0 +1,105 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Shared stand-in shown for animation frames that are still being decoded
+inline Glib::RefPtr<Gdk::Pixbuf> frame_placeholder() {
+    static Glib::RefPtr<Gdk::Pixbuf> placeholder = [] {
+        auto pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, 64, 64);
+        pixbuf->fill(0x80808060); // translucent grey
+        return pixbuf;
+    }();
+    return placeholder;
+}
+
+// Decodes images on a bounded pool of worker threads and hands the results back on the
+// GTK main loop through a Glib::Dispatcher. Must be constructed on the main thread.
+class FrameLoader {
+public:
+    using DecodeFn = std::function<Glib::RefPtr<Gdk::Pixbuf>()>;          // runs on a worker
+    using DeliverFn = std::function<void(Glib::RefPtr<Gdk::Pixbuf>)>;     // runs on the main loop
+
+    explicit FrameLoader(unsigned max_workers = std::thread::hardware_concurrency())
+        : m_max_workers(std::max(1u, max_workers)) {
+        m_dispatcher.connect(sigc::mem_fun(*this, &FrameLoader::on_dispatch));
+    }
+
+    ~FrameLoader() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+            m_jobs.clear();
+        }
+        m_jobs_cv.notify_all();
+        for (auto& worker : m_workers)
+            worker.join();
+    }
+
+    FrameLoader(const FrameLoader&) = delete;
+    FrameLoader& operator=(const FrameLoader&) = delete;
+
+    // Jobs start in submission order; deliveries arrive in completion order
+    void submit(DecodeFn decode, DeliverFn deliver) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back({std::move(decode), std::move(deliver), {}});
+            // Workers are spawned on demand, never more than m_max_workers
+            if (m_workers.size() < m_max_workers && m_jobs.size() > m_idle_workers)
+                m_workers.emplace_back(&FrameLoader::worker_loop, this);
+        }
+        m_jobs_cv.notify_one();
+    }
+
+private:
+    struct Job {
+        DecodeFn decode;
+        DeliverFn deliver;
+        Glib::RefPtr<Gdk::Pixbuf> result;
+    };
+
+    void worker_loop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_idle_workers++;
+            m_jobs_cv.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+            m_idle_workers--;
+            if (m_stopping)
+                return;
+
+            Job job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            lock.unlock();
+            job.result = job.decode();
+            lock.lock();
+
+            m_done.push_back(std::move(job));
+            if (m_done.size() == 1)
+                m_dispatcher.emit(); // one wakeup drains everything finished so far
+        }
+    }
+
+    void on_dispatch() {
+        std::deque<Job> done;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            done.swap(m_done);
+        }
+        for (auto& job : done)
+            job.deliver(job.result);
+    }
+
+    unsigned m_max_workers;
+    unsigned m_idle_workers = 0;
+    bool m_stopping = false;
+    std::mutex m_mutex;
+    std::condition_variable m_jobs_cv;
+    std::deque<Job> m_jobs;
+    std::deque<Job> m_done;
+    std::vector<std::thread> m_workers;
+    Glib::Dispatcher m_dispatcher;
+};
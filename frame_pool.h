@@ -0,0 +1,142 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// 64-bit hash of a pixbuf's visible pixels (row padding excluded), eight bytes at a time with a
+// multiply-rotate mix. Not cryptographic; equal hashes are confirmed byte by byte.
+inline uint64_t pixel_hash(const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) {
+    const int width = pixbuf->get_width(), height = pixbuf->get_height();
+    const size_t row_bytes = static_cast<size_t>(width) * pixbuf->get_n_channels();
+    const guint8* pixels = pixbuf->get_pixels();
+    const uint64_t prime = 0x9E3779B97F4A7C15ull;
+    uint64_t h = (static_cast<uint64_t>(width) << 32 | static_cast<uint32_t>(height)) * prime ^ row_bytes;
+    for (int y = 0; y < height; ++y) {
+        const guint8* row = pixels + static_cast<size_t>(y) * pixbuf->get_rowstride();
+        size_t i = 0;
+        for (; i + 8 <= row_bytes; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, row + i, 8);
+            h = ((h ^ word) * prime);
+            h ^= h >> 29;
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, row + i, row_bytes - i);
+        h = ((h ^ tail ^ (row_bytes - i)) * prime);
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+inline bool same_pixels(const Glib::RefPtr<Gdk::Pixbuf>& a, const Glib::RefPtr<Gdk::Pixbuf>& b) {
+    if (a->get_width() != b->get_width() || a->get_height() != b->get_height() ||
+        a->get_n_channels() != b->get_n_channels() || a->get_has_alpha() != b->get_has_alpha())
+        return false;
+    const size_t row_bytes = static_cast<size_t>(a->get_width()) * a->get_n_channels();
+    for (int y = 0; y < a->get_height(); ++y) {
+        if (std::memcmp(a->get_pixels() + static_cast<size_t>(y) * a->get_rowstride(),
+                        b->get_pixels() + static_cast<size_t>(y) * b->get_rowstride(), row_bytes) != 0)
+            return false;
+    }
+    return true;
+}
+
+// Process-wide set of decoded frames, keyed by pixel content. decode_frame passes every frame
+// through intern(), so repeated frames of a loop, hold frames and identical images reached under
+// different names all come back as the same pixbuf, and with it share one premultiplied surface,
+// opacity mask and mip pyramid. The pool only holds weak references: a frame lives exactly as long
+// as some item (or cache) uses it. Thread-safe.
+class FramePool {
+public:
+    static FramePool& instance() {
+        static FramePool pool;
+        return pool;
+    }
+
+    // The pooled pixbuf with the same pixels as `pixbuf`, or `pixbuf` itself (now pooled).
+    // owns_pixels says whether dropping `pixbuf` frees its pixels; it doesn't when they belong to
+    // an ImageCache entry (the cached image itself, or a crop of it), and then only the surface
+    // the duplicate would have been given counts as saved.
+    Glib::RefPtr<Gdk::Pixbuf> intern(const Glib::RefPtr<Gdk::Pixbuf>& pixbuf, bool owns_pixels) {
+        if (!pixbuf)
+            return pixbuf;
+        uint64_t hash = pixel_hash(pixbuf);
+        m_lookups++;
+
+        std::vector<Glib::RefPtr<Gdk::Pixbuf>> candidates;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto range = m_entries.equal_range(hash);
+            for (auto it = range.first; it != range.second;) {
+                if (auto* object = g_weak_ref_get(it->second.get())) {
+                    candidates.push_back(Glib::wrap(GDK_PIXBUF(object), false));
+                    ++it;
+                } else {
+                    it = m_entries.erase(it); // frame freed since
+                }
+            }
+        }
+        // Compared outside the lock; two threads interning the same new frame at once may both
+        // add it, which only costs the duplicate
+        for (const auto& candidate : candidates) {
+            if (candidate == pixbuf)
+                return candidate;
+            if (same_pixels(candidate, pixbuf)) {
+                m_hits++;
+                size_t height = static_cast<size_t>(pixbuf->get_height());
+                size_t saved = Cairo::ImageSurface::format_stride_for_width(Cairo::FORMAT_ARGB32, pixbuf->get_width()) * height;
+                if (owns_pixels)
+                    saved += static_cast<size_t>(pixbuf->get_rowstride()) * height;
+                m_bytes_saved += saved;
+                return candidate;
+            }
+        }
+
+        std::unique_ptr<GWeakRef, WeakRefDeleter> ref(new GWeakRef);
+        g_weak_ref_init(ref.get(), pixbuf->gobj());
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.emplace(hash, std::move(ref));
+        if (m_entries.size() >= m_sweep_at)
+            sweep();
+        return pixbuf;
+    }
+
+    struct Stats {
+        size_t lookups = 0;
+        size_t hits = 0;         // lookups answered with an existing frame
+        size_t bytes_saved = 0;  // surfaces of the duplicates not kept, plus their pixels if freed
+    };
+
+    Stats stats() const { return {m_lookups.load(), m_hits.load(), m_bytes_saved.load()}; }
+
+private:
+    struct WeakRefDeleter {
+        void operator()(GWeakRef* ref) const {
+            g_weak_ref_clear(ref);
+            delete ref;
+        }
+    };
+
+    // Drops entries whose frames are gone; called with m_mutex held, whenever the table doubles
+    void sweep() {
+        for (auto it = m_entries.begin(); it != m_entries.end();) {
+            if (auto* object = g_weak_ref_get(it->second.get())) {
+                g_object_unref(object);
+                ++it;
+            } else {
+                it = m_entries.erase(it);
+            }
+        }
+        m_sweep_at = std::max<size_t>(1024, 2 * m_entries.size());
+    }
+
+    std::mutex m_mutex;
+    // GWeakRef must stay at one address while registered, hence the indirection
+    std::unordered_multimap<uint64_t, std::unique_ptr<GWeakRef, WeakRefDeleter>> m_entries;
+    size_t m_sweep_at = 1024;
+    std::atomic<size_t> m_lookups{0}, m_hits{0}, m_bytes_saved{0};
+};
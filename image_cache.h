@@ -0,0 +1,200 @@
+#pragma once
+#include <algorithm>
+#include <filesystem>
+#include <future>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "dds_loader.h"
+
+namespace fs = std::filesystem;
+
+// Process-wide cache of decoded source images, keyed by resolved path and modification time.
+// Each file is decoded once no matter how many sprites or frames point at it; crops are taken as
+// create_subpixbuf views, which share the cached pixels and hold a reference on them.
+// Thread-safe: concurrent requests for the same file wait for a single decode.
+class ImageCache {
+public:
+    static ImageCache& instance() {
+        static ImageCache cache;
+        return cache;
+    }
+
+    // Throws Glib::Error if the file cannot be decoded (the failure is not cached)
+    Glib::RefPtr<Gdk::Pixbuf> get(const fs::path& path) {
+        std::error_code ec;
+        fs::path resolved = fs::weakly_canonical(path, ec);
+        if (ec)
+            resolved = path;
+        fs::file_time_type mtime = fs::last_write_time(resolved, ec);
+        std::string key = resolved.string();
+
+        std::promise<Glib::RefPtr<Gdk::Pixbuf>> promise;
+        std::shared_future<Glib::RefPtr<Gdk::Pixbuf>> pending;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_entries.find(key);
+            if (it != m_entries.end() && it->second.mtime == mtime) {
+                m_lru.splice(m_lru.begin(), m_lru, it->second.lru_pos);
+                m_hits++;
+                pending = it->second.pixbuf;
+            } else {
+                if (it != m_entries.end())
+                    erase_entry(it); // file changed on disk
+                Entry& entry = m_entries[key];
+                entry.mtime = mtime;
+                entry.pixbuf = promise.get_future().share();
+                m_lru.push_front(key);
+                entry.lru_pos = m_lru.begin();
+                m_misses++;
+            }
+        }
+        if (pending.valid())
+            return pending.get();
+
+        Glib::RefPtr<Gdk::Pixbuf> pixbuf;
+        try {
+            pixbuf = load_image_file(resolved);
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_entries.find(key);
+            if (it != m_entries.end() && it->second.mtime == mtime)
+                erase_entry(it);
+            throw;
+        }
+        promise.set_value(pixbuf);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(key);
+        if (it != m_entries.end() && it->second.mtime == mtime) {
+            it->second.bytes = static_cast<size_t>(pixbuf->get_rowstride()) * pixbuf->get_height();
+            m_resident_bytes += it->second.bytes;
+            charge_surface(it->second, pixbuf); // DDS textures come with theirs
+            evict_to_cap();
+        }
+        return pixbuf;
+    }
+
+    // Adds the premultiplied surface attached to `pixbuf` to its entry's bytes, if pixbuf is a
+    // cached image (an uncropped, unmasked frame is the cached pixbuf itself). Call after
+    // premultiplied_surface_for, so the cap covers the surface as well as the pixels.
+    void charge_attached_surface(const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) {
+        if (!pixbuf)
+            return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& [key, entry] : m_entries) {
+            if (entry.bytes != 0 && entry.pixbuf.get() == pixbuf) {
+                charge_surface(entry, pixbuf);
+                evict_to_cap();
+                return;
+            }
+        }
+    }
+
+    // 0 disables the cap. Images still referenced by a sprite are never evicted,
+    // since dropping them would not free anything.
+    void set_memory_cap(size_t bytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_memory_cap = bytes;
+        evict_to_cap();
+    }
+
+    size_t resident_bytes() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_resident_bytes;
+    }
+
+    struct PixelRange {
+        const GdkPixbuf* pixbuf;
+        const guint8* pixels;
+        size_t bytes;
+    };
+
+    // Pixel buffers of the decoded entries, sorted by address, so callers can tell a cached image
+    // and crop views into it (create_subpixbuf shares the buffer) from frames with pixels of their own
+    std::vector<PixelRange> pixel_ranges() const {
+        std::vector<PixelRange> ranges;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& [key, entry] : m_entries) {
+            if (entry.bytes == 0)
+                continue;
+            const auto& pixbuf = entry.pixbuf.get();
+            ranges.push_back({pixbuf->gobj(), pixbuf->get_pixels(),
+                              static_cast<size_t>(pixbuf->get_rowstride()) * pixbuf->get_height()});
+        }
+        std::sort(ranges.begin(), ranges.end(), [](const PixelRange& a, const PixelRange& b) { return a.pixels < b.pixels; });
+        return ranges;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+        m_lru.clear();
+        m_resident_bytes = 0;
+    }
+
+    void print_stats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::cout << "Image cache: " << m_entries.size() << " images, " << m_resident_bytes / 1024 << " KiB, "
+                  << m_hits << " hits, " << m_misses << " decodes" << std::endl;
+    }
+
+private:
+    struct Entry {
+        fs::file_time_type mtime;
+        std::shared_future<Glib::RefPtr<Gdk::Pixbuf>> pixbuf;
+        size_t bytes = 0; // pixels plus any attached surface; 0 while the decode is in flight
+        bool surface_charged = false;
+        std::list<std::string>::iterator lru_pos;
+    };
+
+    ImageCache() = default;
+
+    void erase_entry(std::unordered_map<std::string, Entry>::iterator it) {
+        m_resident_bytes -= it->second.bytes;
+        m_lru.erase(it->second.lru_pos);
+        m_entries.erase(it);
+    }
+
+    void charge_surface(Entry& entry, const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) {
+        if (entry.surface_charged)
+            return;
+        if (auto surface = attached_surface(pixbuf)) {
+            size_t bytes = static_cast<size_t>(surface->get_stride()) * surface->get_height();
+            entry.bytes += bytes;
+            m_resident_bytes += bytes;
+            entry.surface_charged = true;
+        }
+    }
+
+    // True while anything besides the cache holds the pixbuf, including subpixbuf crops
+    static bool in_use(const Entry& entry) {
+        const auto& pixbuf = entry.pixbuf.get();
+        return pixbuf && g_atomic_int_get(&G_OBJECT(pixbuf->gobj())->ref_count) > 1;
+    }
+
+    void evict_to_cap() {
+        if (m_memory_cap == 0)
+            return;
+        auto pos = m_lru.end();
+        while (m_resident_bytes > m_memory_cap && pos != m_lru.begin()) {
+            --pos;
+            auto it = m_entries.find(*pos);
+            if (it->second.bytes == 0 || in_use(it->second))
+                continue;
+            auto next = std::next(pos);
+            erase_entry(it);
+            pos = next;
+        }
+    }
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::list<std::string> m_lru; // most recently used first
+    size_t m_resident_bytes = 0;
+    size_t m_memory_cap = 0;
+    size_t m_hits = 0, m_misses = 0;
+};
@@ -1,37 +1,219 @@
 #ifndef IMAGE_ITEM_H
 #pragma once
 #include <filesystem> // C++17, but widely used with C++20
+#include <memory>
+#include <unordered_set>
+#include "alpha_composite.h"
+#include "frame_pool.h"
+#include "mip_pyramid.h"
+#include "opacity_mask.h"
 namespace fs = std::filesystem;
 
+struct ParsedFrameInfo {
+    fs::path image_path;
+    bool has_alpha_mask_in_frame_line = false; // For .ani files, if 'true' is present
+    fs::path alpha_mask_path; // Separate mask image (static sprites), empty if none
+
+    // Cropping parameters (if found for this frame or overall)
+    double mins = 0.0; // Default to full image (0%)
+    double mint = 0.0;
+    double maxs = 1.0; // Default to full image (100%)
+    double maxt = 1.0;
+
+    bool has_cropping = false; // True if mins/mint/maxs/maxt were explicitly defined
+};
+
+// Backing store for frames decoded on demand instead of held in ImageItem::frames
+// (implemented by LazyFrameStore in lazy_frame_store.h)
+struct FrameSource {
+    virtual ~FrameSource() = default;
+    virtual size_t size() const = 0;
+    virtual Glib::RefPtr<Gdk::Pixbuf> get(size_t index) = 0; // may be a stand-in while decoding
+    // The frame itself, decoded on the calling thread if need be (for exports, not for drawing)
+    virtual Glib::RefPtr<Gdk::Pixbuf> get_decoded(size_t index) { return get(index); }
+    virtual bool is_resident(size_t index) const = 0;
+    virtual size_t eviction_count() const = 0; // bumped whenever a frame is dropped
+    virtual Glib::RefPtr<Gdk::Pixbuf> resident(size_t index) const = 0; // nullptr if not resident; never decodes
+    virtual void replace(size_t index, const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) = 0; // e.g. after the file changed
+};
+
+// Axis-aligned box in canvas coordinates (origin at the canvas centre)
+struct ItemBounds {
+    double left = 0, top = 0, width = 0, height = 0;
+
+    bool empty() const { return width <= 0 || height <= 0; }
+
+    bool intersects(double x1, double y1, double x2, double y2) const {
+        return !empty() && left < x2 && left + width > x1 && top < y2 && top + height > y1;
+    }
+
+    ItemBounds united(const ItemBounds& other) const {
+        if (empty()) return other;
+        if (other.empty()) return *this;
+        double l = std::min(left, other.left);
+        double t = std::min(top, other.top);
+        double r = std::max(left + width, other.left + other.width);
+        double b = std::max(top + height, other.top + other.height);
+        return {l, t, r - l, b - t};
+    }
+};
+
 struct ImageItem {
     std::vector<Glib::RefPtr<Gdk::Pixbuf>> frames;  // Multiple frames
     double x = 0, y = 0;
     double scale_x = 1.0, scale_y = 1.0;
     bool selected = false;
     double frame_delay_ms = 100; // Delay between frames in milliseconds
+    size_t current_frame = 0;        // Frame currently shown on the canvas
+    gint64 animation_start_us = -1;  // Frame-clock time playback started, -1 until the first tick
 
     // Information about the original SPR file (for internal use, not part of public API)
+    fs::path source_path;             // File the item was loaded from (.spr/.ani or an image)
     fs::path static_image_filepath;   // For static images
     fs::path alpha_mask_filepath;     // For static images, can be empty
     bool is_animation = false;        // True if it's an animation
     bool has_static_alpha_mask = false; // True if static_image has an alpha mask file
+    std::vector<ParsedFrameInfo> frame_infos; // Frame lines as parsed, one per frame
+
+    // When set, frames are decoded on demand from here and `frames` stays empty
+    std::shared_ptr<FrameSource> lazy_frames;
+
+    // Box the item occupied the last time it was painted, used for damage tracking
+    ItemBounds drawn_bounds;
+
+    // Ready-to-paint copies of the frames at the current scale times the view zoom, built on first
+    // use. Rebuilt when either changes; call invalidate_scaled_cache() after touching frames.
+    mutable std::vector<Cairo::RefPtr<Cairo::ImageSurface>> scaled_cache;
+    mutable double cached_scale_x = 0, cached_scale_y = 0;
+    mutable size_t cached_eviction_count = 0;
+
+    size_t frame_count() const {
+        return lazy_frames ? lazy_frames->size() : frames.size();
+    }
 
     // Access current frame (e.g. from external animation controller)
     Glib::RefPtr<Gdk::Pixbuf> get_frame(size_t frame_index) const {
-        if (frames.empty())
+        size_t count = frame_count();
+        if (count == 0)
             return {};
-        return frames[frame_index % frames.size()];
+        if (lazy_frames)
+            return lazy_frames->get(frame_index % count);
+        return frames[frame_index % count];
     }
 
-    bool contains(double px, double py, size_t frame_index = 0) const {
+    // Like get_frame, but never a stand-in for a lazy frame still decoding; may decode here
+    Glib::RefPtr<Gdk::Pixbuf> decoded_frame(size_t frame_index) const {
+        size_t count = frame_count();
+        if (count == 0)
+            return {};
+        if (lazy_frames)
+            return lazy_frames->get_decoded(frame_index % count);
+        return frames[frame_index % count];
+    }
+
+    bool is_animated() const {
+        return frame_count() > 1 && frame_delay_ms > 0;
+    }
+
+    // Frame to show after elapsed_ms of playback, using this item's own frame delay
+    size_t frame_at(double elapsed_ms) const {
+        if (!is_animated() || elapsed_ms < 0)
+            return 0;
+        return static_cast<size_t>(elapsed_ms / frame_delay_ms) % frame_count();
+    }
+
+    void invalidate_scaled_cache() const {
+        scaled_cache.clear();
+    }
+
+    // Swaps in a newly decoded frame, e.g. after its image changed on disk
+    void replace_frame(size_t frame_index, const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) {
+        if (frame_index >= frame_count())
+            return;
+        if (lazy_frames)
+            lazy_frames->replace(frame_index, pixbuf);
+        else
+            frames[frame_index] = pixbuf;
+        if (frame_index < scaled_cache.size())
+            scaled_cache[frame_index].clear();
+    }
+
+    // Frame as it appears on screen: scaled by scale_x/scale_y times view_zoom, built once from the
+    // nearest mip level of the frame's premultiplied surface and reused across redraws; at 1:1 that
+    // surface is returned as is. When a draw target is given, scaled copies are created as images
+    // similar to it so the backend can upload them efficiently. Returns an empty RefPtr when a
+    // zoomed-in view magnifies the frame: such a copy would only cost memory, so the caller samples
+    // the frame surface directly.
+    Cairo::RefPtr<Cairo::ImageSurface> get_scaled_surface(size_t frame_index,
+                                                          const Cairo::RefPtr<Cairo::Surface>& target = {},
+                                                          double view_zoom = 1.0) const {
+        size_t count = frame_count();
+        if (count == 0)
+            return {};
+        double sx = scale_x * view_zoom, sy = scale_y * view_zoom;
+        if (view_zoom != 1.0 && (sx > 1.0 || sy > 1.0))
+            return {};
+        if (cached_scale_x != sx || cached_scale_y != sy || scaled_cache.size() != count) {
+            scaled_cache.clear();
+            scaled_cache.resize(count);
+            cached_scale_x = sx;
+            cached_scale_y = sy;
+        }
+        // Scaled copies of frames the lazy store has dropped must go too, or the budget means nothing
+        if (lazy_frames && lazy_frames->eviction_count() != cached_eviction_count) {
+            cached_eviction_count = lazy_frames->eviction_count();
+            for (size_t i = 0; i < count; ++i) {
+                if (!lazy_frames->is_resident(i))
+                    scaled_cache[i].clear();
+            }
+        }
+
+        size_t index = frame_index % count;
+        if (scaled_cache[index])
+            return scaled_cache[index];
+
+        auto pixbuf = get_frame(index);
+        auto source = premultiplied_surface_for(pixbuf);
+        if (!source)
+            return {};
+        if (sx == 1.0 && sy == 1.0) {
+            scaled_cache[index] = source;
+            return source;
+        }
+        int w = std::max(1, static_cast<int>(pixbuf->get_width() * sx));
+        int h = std::max(1, static_cast<int>(pixbuf->get_height() * sy));
+        if (sx < 1.0 || sy < 1.0)
+            source = mip_pyramid_for(pixbuf)->level_for(double(w) / pixbuf->get_width(), double(h) / pixbuf->get_height());
+        auto surface = create_similar_surface(target, w, h);
+        auto cr = Cairo::Context::create(surface);
+        cr->scale(double(w) / source->get_width(), double(h) / source->get_height());
+        cr->set_source(source, 0, 0);
+        cr->paint();
+        scaled_cache[index] = surface;
+        return surface;
+    }
+
+    ItemBounds bounds(size_t frame_index = 0) const {
         auto pixbuf = get_frame(frame_index);
-        if (!pixbuf) return false;
+        if (!pixbuf) return {};
 
         double w = pixbuf->get_width() * scale_x;
         double h = pixbuf->get_height() * scale_y;
-        double left = x - w / 2.0;
-        double top = y - h / 2.0;
-        return px >= left && px <= left + w && py >= top && py <= top + h;
+        return {x - w / 2.0, y - h / 2.0, w, h};
+    }
+
+    // Bounding-box test first, then the frame's opacity mask, so clicks on transparent pixels miss
+    bool contains(double px, double py, size_t frame_index = 0) const {
+        ItemBounds b = bounds(frame_index);
+        if (b.empty()) return false;
+        if (px < b.left || px > b.left + b.width || py < b.top || py > b.top + b.height)
+            return false;
+
+        const OpacityMask* mask = opacity_mask_for(get_frame(frame_index));
+        if (!mask) return true;
+        int fx = std::clamp(static_cast<int>((px - b.left) / scale_x), 0, mask->width() - 1);
+        int fy = std::clamp(static_cast<int>((py - b.top) / scale_y), 0, mask->height() - 1);
+        return mask->opaque_at(fx, fy);
     }
 
     // For debugging/inspection
@@ -46,8 +228,15 @@ struct ImageItem {
                 std::cout << "Alpha Mask File: " << alpha_mask_filepath << std::endl;
             }
         } else {
-            std::cout << "Number of Frames (loaded): " << frames.size() << std::endl;
+            std::cout << "Number of Frames (loaded): " << frame_count() << (lazy_frames ? " (decoded on demand)" : "") << std::endl;
             std::cout << "Frame Delay (ms): " << frame_delay_ms << std::endl;
+            std::unordered_set<const Gdk::Pixbuf*> unique;
+            for (const auto& frame : frames) {
+                if (frame) unique.insert(frame.operator->());
+            }
+            if (!unique.empty())
+                std::cout << "Unique Frames: " << unique.size() << " of " << frames.size() << " (dedup ratio "
+                          << double(frames.size()) / unique.size() << ":1)" << std::endl;
 
             // This part might be less useful without the original parsedFrameInfo
             // but we can still show which frames were loaded.
@@ -61,6 +250,9 @@ struct ImageItem {
         std::cout << "Scale: " << scale_x << "x, " << scale_y << "y" << std::endl;
         std::cout << "Position: " << x << ", " << y << std::endl;
         std::cout << "Selected: " << (selected ? "true" : "false") << std::endl;
+        FramePool::Stats pool = FramePool::instance().stats();
+        std::cout << "Frame Pool: " << pool.hits << " of " << pool.lookups << " decoded frames shared, "
+                  << pool.bytes_saved / 1024 << " KiB saved" << std::endl;
         std::cout << "----------------------" << std::endl;
     }
 };
@@ -0,0 +1,299 @@
+#pragma once
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "asset_config.h"
+#include "atomic_file.h"
+#include "image_item.h"
+#include "mapped_file.h"
+#include "spr_parser.h"
+
+// Writers for the sprite (.spr/.ani), cockpit (.cpt) and base (.py) formats, and a reader for the
+// layouts written here. Layouts only reference the files items were loaded from; no pixels are
+// re-encoded. Every file is written through AtomicFileWriter, so a failed save leaves the previous
+// file intact.
+
+// Canvas size in pixels that Vega Strike's -1..1 screen coordinates (y up) are mapped onto
+struct LayoutCanvas {
+    double width = 800, height = 600;
+};
+
+// One item of a saved layout, as needed to recreate it
+struct LayoutEntry {
+    fs::path source;
+    double x = 0, y = 0;
+    double scale_x = 1, scale_y = 1;
+};
+
+constexpr std::string_view layout_signature = "Written by vs_spredit. Canvas ";
+
+// File a layout refers to for this item: the sprite it came from, or its image
+inline fs::path layout_source(const ImageItem& item) {
+    return item.source_path.empty() ? item.static_image_filepath : item.source_path;
+}
+
+// --- Sprite ---
+// Static sprites keep their image and mask paths; animations keep their frame lines (paths, mask
+// keyword and crops). Line 2 holds the displayed size in pixels.
+inline bool write_sprite_file(const ImageItem& item, const fs::path& path, const fs::path& asset_root_dir) {
+    auto frame = item.decoded_frame(0);
+    double width = frame ? frame->get_width() * item.scale_x : 0;
+    double height = frame ? frame->get_height() * item.scale_y : 0;
+
+    AtomicFileWriter writer(path);
+    std::ostream& out = writer.stream();
+    out << std::setprecision(10);
+    if (item.is_animation) {
+        if (item.frame_infos.empty()) {
+            std::cerr << "Error: animation has no frame list to save." << std::endl;
+            return false;
+        }
+        out << width << " " << height << "\n" << width << " " << height << "\n"
+            << item.frame_infos.size() << " " << static_cast<int>(item.frame_delay_ms) << "\n";
+        for (const auto& info : item.frame_infos) {
+            out << asset_relative_path(info.image_path, asset_root_dir);
+            if (info.has_alpha_mask_in_frame_line)
+                out << " true";
+            if (info.has_cropping) {
+                out << std::setprecision(std::numeric_limits<double>::max_digits10)
+                    << " mins=" << info.mins << ",mint=" << info.mint << ",maxs=" << info.maxs << ",maxt=" << info.maxt
+                    << std::setprecision(10);
+            }
+            out << "\n";
+        }
+    } else {
+        fs::path image = item.static_image_filepath.empty() ? item.source_path : item.static_image_filepath;
+        if (image.empty()) {
+            std::cerr << "Error: item has no source image to save." << std::endl;
+            return false;
+        }
+        out << asset_relative_path(image, asset_root_dir) << " "
+            << (item.has_static_alpha_mask ? asset_relative_path(item.alpha_mask_filepath, asset_root_dir) : "0") << "\n"
+            << width << " " << height << "\n"
+            << "0 0\n";
+    }
+    return writer.commit();
+}
+
+// --- Base ---
+inline std::string python_quote(const std::string& s) {
+    std::string out = "'";
+    for (char c : s) {
+        if (c == '\\' || c == '\'')
+            out += '\\';
+        out += c;
+    }
+    return out + "'";
+}
+
+inline bool write_base_layout(const std::vector<std::shared_ptr<ImageItem>>& items, const fs::path& path,
+                              const fs::path& asset_root_dir, const LayoutCanvas& canvas) {
+    AtomicFileWriter writer(path);
+    std::ostream& out = writer.stream();
+    out << std::setprecision(10);
+    out << "# " << layout_signature << canvas.width << "x" << canvas.height
+        << "; positions are Vega Strike screen units (-1..1, y up).\n"
+        << "import Base\n\n"
+        << "room = Base.Room(" << python_quote(path.stem().string()) << ")\n";
+    for (size_t i = 0; i < items.size(); ++i) {
+        const ImageItem& item = *items[i];
+        fs::path source = layout_source(item);
+        if (source.empty()) {
+            std::cerr << "Warning: item " << i << " has no source file; not saved." << std::endl;
+            continue;
+        }
+        out << "Base.Texture(room, 'tex" << i << "', " << python_quote(asset_relative_path(source, asset_root_dir)) << ", "
+            << item.x / (canvas.width / 2.0) << ", " << -item.y / (canvas.height / 2.0) << ")"
+            << "  # scale " << item.scale_x << " " << item.scale_y << "\n";
+    }
+    return writer.commit();
+}
+
+// --- Cockpit ---
+inline std::string xml_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        switch (c) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            default: out += c;
+        }
+    }
+    return out;
+}
+
+// Panel width/height are the displayed size in screen units, as the game reads them; scalex and
+// scaley are the editor's own and are ignored by the game.
+inline bool write_cockpit_layout(const std::vector<std::shared_ptr<ImageItem>>& items, const fs::path& path,
+                                 const fs::path& asset_root_dir, const LayoutCanvas& canvas) {
+    AtomicFileWriter writer(path);
+    std::ostream& out = writer.stream();
+    out << std::setprecision(10);
+    out << "<?xml version=\"1.0\"?>\n"
+        << "<!-- " << layout_signature << canvas.width << "x" << canvas.height << " -->\n"
+        << "<Cockpit>\n";
+    for (size_t i = 0; i < items.size(); ++i) {
+        const ImageItem& item = *items[i];
+        fs::path source = layout_source(item);
+        if (source.empty()) {
+            std::cerr << "Warning: item " << i << " has no source file; not saved." << std::endl;
+            continue;
+        }
+        ItemBounds b = item.bounds(item.current_frame);
+        out << "  <Panel file=\"" << xml_escape(asset_relative_path(source, asset_root_dir)) << "\""
+            << " xcent=\"" << item.x / (canvas.width / 2.0) << "\" ycent=\"" << -item.y / (canvas.height / 2.0) << "\""
+            << " width=\"" << b.width / (canvas.width / 2.0) << "\" height=\"" << b.height / (canvas.height / 2.0) << "\""
+            << " scalex=\"" << item.scale_x << "\" scaley=\"" << item.scale_y << "\"/>\n";
+    }
+    out << "</Cockpit>\n";
+    return writer.commit();
+}
+
+// --- Reading ---
+namespace layout_detail {
+
+inline void read_canvas(std::string_view contents, LayoutCanvas& canvas) {
+    size_t pos = contents.find(layout_signature);
+    if (pos == std::string_view::npos)
+        return;
+    std::string_view rest = contents.substr(pos + layout_signature.size());
+    size_t x = rest.find('x');
+    size_t end = rest.find_first_of(" ;\r\n", x);
+    double w, h;
+    if (x != std::string_view::npos && parse_double(rest.substr(0, x), w) &&
+        parse_double(rest.substr(x + 1, end == std::string_view::npos ? end : end - x - 1), h) && w > 0 && h > 0)
+        canvas = {w, h};
+}
+
+// Arguments of a call, split at top-level commas; quoted strings are unescaped
+inline std::vector<std::string> call_arguments(std::string_view text, size_t& end) {
+    std::vector<std::string> args(1);
+    char quote = 0;
+    for (end = 0; end < text.size(); ++end) {
+        char c = text[end];
+        if (quote) {
+            if (c == '\\' && end + 1 < text.size())
+                args.back() += text[++end];
+            else if (c == quote)
+                quote = 0;
+            else
+                args.back() += c;
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == ',') {
+            args.emplace_back();
+        } else if (c == ')') {
+            break;
+        } else if (!is_space(c)) {
+            args.back() += c;
+        }
+    }
+    return args;
+}
+
+inline std::string xml_attribute(std::string_view tag, std::string_view name) {
+    std::string key = " " + std::string(name) + "=\"";
+    size_t pos = tag.find(key);
+    if (pos == std::string_view::npos)
+        return {};
+    std::string_view value = tag.substr(pos + key.size());
+    value = value.substr(0, value.find('"'));
+    std::string out;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == '&') {
+            static const std::pair<std::string_view, char> entities[] = {
+                {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}};
+            bool matched = false;
+            for (const auto& [entity, ch] : entities) {
+                if (value.substr(i, entity.size()) == entity) {
+                    out += ch;
+                    i += entity.size() - 1;
+                    matched = true;
+                    break;
+                }
+            }
+            if (matched)
+                continue;
+        }
+        out += value[i];
+    }
+    return out;
+}
+
+inline fs::path resolve(const std::string& path, const fs::path& asset_root_dir) {
+    fs::path p(path);
+    return p.is_absolute() ? p : asset_root_dir / p;
+}
+
+} // namespace layout_detail
+
+// Reads a base (.py) or cockpit (.cpt) layout. Positions are mapped back through the canvas size
+// recorded in the file, or `canvas` if it has none. Returns false if the file can't be read.
+inline bool read_layout(const fs::path& path, const fs::path& asset_root_dir, LayoutCanvas canvas,
+                        std::vector<LayoutEntry>& entries) {
+    using namespace layout_detail;
+    MappedFile file(path.string());
+    if (!file.is_open()) {
+        std::cerr << "Error: cannot open layout " << path << std::endl;
+        return false;
+    }
+    std::string_view contents = file.view();
+    read_canvas(contents, canvas);
+    double half_w = canvas.width / 2.0, half_h = canvas.height / 2.0;
+    entries.clear();
+
+    if (path.extension() == ".cpt") {
+        for (size_t pos = contents.find("<Panel"); pos != std::string_view::npos; pos = contents.find("<Panel", pos + 1)) {
+            std::string_view tag = contents.substr(pos, contents.find('>', pos) - pos);
+            LayoutEntry entry;
+            std::string source = xml_attribute(tag, "file");
+            if (source.empty())
+                continue;
+            entry.source = resolve(source, asset_root_dir);
+            double v;
+            if (parse_double(xml_attribute(tag, "xcent"), v)) entry.x = v * half_w;
+            if (parse_double(xml_attribute(tag, "ycent"), v)) entry.y = -v * half_h;
+            if (parse_double(xml_attribute(tag, "scalex"), v)) entry.scale_x = v;
+            if (parse_double(xml_attribute(tag, "scaley"), v)) entry.scale_y = v;
+            entries.push_back(entry);
+        }
+        return true;
+    }
+
+    std::string_view line;
+    while (next_line(contents, line)) {
+        size_t pos = line.find("Base.Texture(");
+        if (pos == std::string_view::npos)
+            continue;
+        std::string_view call = line.substr(pos + std::string_view("Base.Texture(").size());
+        size_t end;
+        auto args = call_arguments(call, end);
+        double x, y;
+        if (args.size() < 5 || args[2].empty() || !parse_double(args[3], x) || !parse_double(args[4], y)) {
+            std::cerr << "Warning: skipping unrecognised line in " << path << ": " << line << std::endl;
+            continue;
+        }
+        LayoutEntry entry;
+        entry.source = resolve(args[2], asset_root_dir);
+        entry.x = x * half_w;
+        entry.y = -y * half_h;
+        // Editor scale from the trailing "# scale sx sy" comment, if present
+        std::string_view comment = end < call.size() ? call.substr(end) : std::string_view();
+        size_t scale_pos = comment.find("# scale ");
+        if (scale_pos != std::string_view::npos) {
+            std::string_view rest = comment.substr(scale_pos + 8);
+            double sx, sy;
+            if (parse_double(next_token(rest), sx) && parse_double(next_token(rest), sy)) {
+                entry.scale_x = sx;
+                entry.scale_y = sy;
+            }
+        }
+        entries.push_back(entry);
+    }
+    return true;
+}
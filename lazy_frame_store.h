@@ -0,0 +1,214 @@
+#pragma once
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+#include "spr_parser.h"
+#include "frame_loader.h"
+
+class LazyFrameStore;
+
+// Process-wide byte budget shared by every LazyFrameStore. Frames are evicted least recently
+// used first once the decoded pixels of all lazy animations exceed the budget. Only the pixbuf and
+// its premultiplied surface are counted; a frame's mip levels (up to a third more, zoomed out) and
+// the item's scaled copy go when the frame does, but are not charged.
+// Main-thread only: stores are read from on_draw and filled from FrameLoader deliveries.
+class FrameBudget {
+public:
+    size_t budget_bytes = 256u << 20;   // Decoded frame pixels kept resident across all lazy animations
+    size_t prefetch_ahead = 8;          // Frames decoded in the background ahead of the playhead
+    size_t lazy_threshold_frames = 32;  // Animations with more frames than this load lazily
+
+    static FrameBudget& instance() {
+        static FrameBudget budget;
+        return budget;
+    }
+
+    size_t resident_bytes() const { return m_resident_bytes; }
+
+private:
+    friend class LazyFrameStore;
+    struct Resident {
+        LazyFrameStore* store;
+        size_t index;
+    };
+    using Lru = std::list<Resident>; // most recently used first
+
+    Lru::iterator add(LazyFrameStore* store, size_t index, size_t bytes) {
+        m_resident_bytes += bytes;
+        m_lru.push_front({store, index});
+        return m_lru.begin();
+    }
+
+    void touch(Lru::iterator pos) { m_lru.splice(m_lru.begin(), m_lru, pos); }
+
+    void remove(Lru::iterator pos, size_t bytes) {
+        m_resident_bytes -= bytes;
+        m_lru.erase(pos);
+    }
+
+    void trim();
+
+    Lru m_lru;
+    size_t m_resident_bytes = 0;
+};
+
+// Frame source that keeps only the parsed frame list up front. Frames are decoded on first use,
+// the next few are prefetched on the FrameLoader pool, and anything outside FrameBudget is dropped.
+// A frame that isn't resident when asked for is never decoded on the caller's (main) thread: the
+// last frame handed out stands in for it, the decode is queued, and on_frame_ready(index) runs
+// once it lands so the item can be repainted.
+class LazyFrameStore : public FrameSource, public std::enable_shared_from_this<LazyFrameStore> {
+public:
+    LazyFrameStore(std::vector<ParsedFrameInfo> frame_infos, FrameLoader* loader,
+                   std::function<void(size_t)> on_frame_ready = nullptr)
+        : m_infos(std::move(frame_infos)), m_slots(m_infos.size()), m_loader(loader),
+          m_on_frame_ready(std::move(on_frame_ready)) {}
+
+    ~LazyFrameStore() override {
+        for (auto& slot : m_slots) {
+            if (slot.state == Slot::Resident)
+                FrameBudget::instance().remove(slot.lru_pos, slot.bytes);
+        }
+    }
+
+    size_t size() const override { return m_infos.size(); }
+
+    bool is_resident(size_t index) const override { return m_slots[index].state == Slot::Resident; }
+
+    size_t eviction_count() const override { return m_evictions; }
+
+    Glib::RefPtr<Gdk::Pixbuf> resident(size_t index) const override {
+        return m_slots[index].state == Slot::Resident ? m_slots[index].pixbuf : Glib::RefPtr<Gdk::Pixbuf>();
+    }
+
+    Glib::RefPtr<Gdk::Pixbuf> get(size_t index) override {
+        Slot& slot = m_slots[index];
+        if (slot.state == Slot::Resident) {
+            FrameBudget::instance().touch(slot.lru_pos);
+            m_last_shown = slot.pixbuf;
+        } else if (slot.state != Slot::Failed) {
+            if (!m_loader) {
+                store(index, decode_now(m_infos[index])); // no worker pool (command-line tools)
+                m_last_shown = m_slots[index].pixbuf;
+            } else {
+                // Not prefetched in time, or evicted: show the previous frame until this one lands
+                if (slot.state == Slot::Empty)
+                    queue_decode(index);
+                slot.wanted = true;
+            }
+        }
+        prefetch_after(index);
+        if (m_slots[index].state == Slot::Resident || m_slots[index].state == Slot::Failed)
+            return m_slots[index].pixbuf;
+        return m_last_shown ? m_last_shown : frame_placeholder();
+    }
+
+    Glib::RefPtr<Gdk::Pixbuf> get_decoded(size_t index) override {
+        Slot& slot = m_slots[index];
+        if (slot.state == Slot::Resident)
+            FrameBudget::instance().touch(slot.lru_pos);
+        else if (slot.state != Slot::Failed)
+            store(index, decode_now(m_infos[index])); // a pending prefetch is dropped on delivery
+        return m_slots[index].pixbuf;
+    }
+
+    // Also settles a prefetch still in flight for the old file: its result is dropped on delivery
+    void replace(size_t index, const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) override {
+        if (m_slots[index].state == Slot::Resident)
+            FrameBudget::instance().remove(m_slots[index].lru_pos, m_slots[index].bytes);
+        m_slots[index] = Slot{};
+        store(index, pixbuf);
+    }
+
+private:
+    friend class FrameBudget;
+    struct Slot {
+        enum State { Empty, Pending, Resident, Failed } state = Empty;
+        bool wanted = false; // asked for while pending; the item is showing a stand-in
+        Glib::RefPtr<Gdk::Pixbuf> pixbuf;
+        size_t bytes = 0;
+        FrameBudget::Lru::iterator lru_pos;
+    };
+
+    void store(size_t index, const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) {
+        Slot& slot = m_slots[index];
+        if (slot.state == Slot::Resident)
+            return;
+        if (!pixbuf) {
+            slot.state = Slot::Failed; // same as an empty entry in ImageItem::frames
+            return;
+        }
+        slot.state = Slot::Resident;
+        slot.wanted = false;
+        slot.pixbuf = pixbuf;
+        slot.bytes = static_cast<size_t>(pixbuf->get_rowstride()) * pixbuf->get_height();
+        if (auto surface = attached_surface(pixbuf))
+            slot.bytes += static_cast<size_t>(surface->get_stride()) * surface->get_height();
+        slot.lru_pos = FrameBudget::instance().add(this, index, slot.bytes);
+        FrameBudget::instance().trim();
+    }
+
+    void evict(size_t index) {
+        Slot& slot = m_slots[index];
+        FrameBudget::instance().remove(slot.lru_pos, slot.bytes);
+        slot = Slot{};
+        m_evictions++;
+    }
+
+    static Glib::RefPtr<Gdk::Pixbuf> decode_now(const ParsedFrameInfo& p_frame_info) {
+        try {
+            return decode_frame(p_frame_info);
+        } catch (const Glib::Error& ex) {
+            spr_log(SprSeverity::Error, "missing_frame") << "Cannot load animation frame '" << p_frame_info.image_path << "': " << ex.what();
+            return {};
+        }
+    }
+
+    void queue_decode(size_t index) {
+        m_slots[index].state = Slot::Pending;
+        std::weak_ptr<LazyFrameStore> weak_store = weak_from_this();
+        ParsedFrameInfo p_frame_info = m_infos[index];
+        m_loader->submit(
+            [weak_store, p_frame_info]() -> Glib::RefPtr<Gdk::Pixbuf> {
+                if (weak_store.expired())
+                    return {};
+                return decode_now(p_frame_info);
+            },
+            [weak_store, index](Glib::RefPtr<Gdk::Pixbuf> pixbuf) {
+                auto store = weak_store.lock();
+                if (!store || store->m_slots[index].state != Slot::Pending)
+                    return;
+                bool wanted = store->m_slots[index].wanted;
+                store->store(index, pixbuf);
+                if (wanted && store->m_on_frame_ready)
+                    store->m_on_frame_ready(index);
+            });
+    }
+
+    void prefetch_after(size_t index) {
+        if (!m_loader)
+            return;
+        size_t ahead = std::min(FrameBudget::instance().prefetch_ahead, m_infos.size() - 1);
+        for (size_t step = 1; step <= ahead; ++step) {
+            size_t next = (index + step) % m_infos.size();
+            if (m_slots[next].state == Slot::Empty)
+                queue_decode(next);
+        }
+    }
+
+    std::vector<ParsedFrameInfo> m_infos;
+    std::vector<Slot> m_slots;
+    FrameLoader* m_loader;
+    std::function<void(size_t)> m_on_frame_ready;
+    Glib::RefPtr<Gdk::Pixbuf> m_last_shown; // stand-in for frames still decoding; outside the budget
+    size_t m_evictions = 0;
+};
+
+inline void FrameBudget::trim() {
+    // The most recently used frame always stays, even if it alone exceeds the budget
+    while (m_resident_bytes > budget_bytes && m_lru.size() > 1) {
+        Resident victim = m_lru.back();
+        victim.store->evict(victim.index);
+    }
+}
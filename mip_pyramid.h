@@ -0,0 +1,162 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "alpha_composite.h"
+
+namespace mip_detail {
+
+// One row of a 2x2 box filter over premultiplied ARGB32: out[x] averages src pixels 2x and 2x+1
+// of rows row0 and row1. An odd last column is averaged with itself.
+inline void downsample_row(const uint8_t* row0, const uint8_t* row1, int src_width, uint8_t* out, int out_width) {
+    int x = 0;
+#if defined(__SSE2__)
+    // 8 source pixels -> 4 output pixels; avg of avgs rounds up by at most 1
+    for (; x + 4 <= out_width && 2 * x + 8 <= src_width; x += 4) {
+        const uint8_t* a = row0 + 8 * x;
+        const uint8_t* b = row1 + 8 * x;
+        __m128i v0 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+        __m128i v1 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 16)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 16)));
+        // [p0 p2 p1 p3], [p4 p6 p5 p7] -> even pixels and odd pixels
+        __m128i s0 = _mm_shuffle_epi32(v0, _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i s1 = _mm_shuffle_epi32(v1, _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i even = _mm_unpacklo_epi64(s0, s1);
+        __m128i odd = _mm_unpackhi_epi64(s0, s1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * x), _mm_avg_epu8(even, odd));
+    }
+#endif
+    for (; x < out_width; ++x) {
+        int x0 = 2 * x, x1 = std::min(2 * x + 1, src_width - 1);
+        for (int c = 0; c < 4; ++c) {
+            unsigned sum = row0[4 * x0 + c] + row0[4 * x1 + c] + row1[4 * x0 + c] + row1[4 * x1 + c];
+            out[4 * x + c] = static_cast<uint8_t>((sum + 2) / 4);
+        }
+    }
+}
+
+inline Cairo::RefPtr<Cairo::ImageSurface> downsample(const Cairo::RefPtr<Cairo::ImageSurface>& src) {
+    int w = src->get_width(), h = src->get_height();
+    int out_w = (w + 1) / 2, out_h = (h + 1) / 2;
+    auto out = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, out_w, out_h);
+    src->flush();
+    const uint8_t* src_data = src->get_data();
+    uint8_t* out_data = out->get_data();
+    int src_stride = src->get_stride(), out_stride = out->get_stride();
+    for (int y = 0; y < out_h; ++y) {
+        const uint8_t* row0 = src_data + static_cast<size_t>(2 * y) * src_stride;
+        const uint8_t* row1 = src_data + static_cast<size_t>(std::min(2 * y + 1, h - 1)) * src_stride;
+        downsample_row(row0, row1, w, out_data + static_cast<size_t>(y) * out_stride, out_w);
+    }
+    out->mark_dirty();
+    return out;
+}
+
+} // namespace mip_detail
+
+// Smaller copies of a frame that came with its file (the mip chain of a DDS texture); level 0 is
+// the frame itself. Levels are produced on request.
+struct EmbeddedMips {
+    virtual ~EmbeddedMips() = default;
+    virtual size_t count() const = 0;
+    virtual Cairo::RefPtr<Cairo::ImageSurface> level(size_t index) const = 0;
+};
+
+inline const Glib::Quark& embedded_mips_quark() {
+    static const Glib::Quark quark("vs-spredit-embedded-mips");
+    return quark;
+}
+
+// Offers a decoder's own mip levels to the pixbuf's MipPyramid. Call before the pixbuf is shared.
+inline void attach_embedded_mips(const Glib::RefPtr<Gdk::Pixbuf>& pixbuf, std::shared_ptr<EmbeddedMips> mips) {
+    pixbuf->set_data(embedded_mips_quark(), new std::shared_ptr<EmbeddedMips>(std::move(mips)),
+                     [](void* data) { delete static_cast<std::shared_ptr<EmbeddedMips>*>(data); });
+}
+
+// Successively halved copies of a frame's premultiplied surface (level 0 is the surface itself),
+// built on demand. Zoomed-out views scale from the smallest level that is still at least as large
+// as the size on screen, so a minified frame costs a quarter of the pixels per level dropped and
+// cairo never has to minify by more than 2x (where its bilinear filter still looks right).
+// Levels the file already had (EmbeddedMips) are used instead of downsampling when their size
+// matches.
+// Levels are not charged to FrameBudget or ImageCache: they live and die with the frame's pixbuf,
+// are only built for frames drawn zoomed out, and add at most a third of the frame's surface.
+// The performance overlay does count them (extra_bytes).
+class MipPyramid {
+public:
+    explicit MipPyramid(Cairo::RefPtr<Cairo::ImageSurface> base, std::shared_ptr<EmbeddedMips> embedded = nullptr)
+        : m_embedded(std::move(embedded)) {
+        m_levels.push_back(std::move(base));
+    }
+
+    // Smallest level at least scale_x/scale_y times the base size; level 0 for scales of 1 or more
+    Cairo::RefPtr<Cairo::ImageSurface> level_for(double scale_x, double scale_y) {
+        int base_w = m_levels[0]->get_width(), base_h = m_levels[0]->get_height();
+        double need_w = base_w * scale_x, need_h = base_h * scale_y;
+        size_t level = 0;
+        for (int w = base_w, h = base_h; w > 1 || h > 1; ++level) {
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+            if (w < need_w || h < need_h)
+                break;
+            if (level + 1 == m_levels.size()) {
+                // A stored level is used only at exactly the size checked above; DDS rounds odd
+                // sides down where this rounds up, and a smaller level would then be magnified
+                Cairo::RefPtr<Cairo::ImageSurface> next;
+                if (m_embedded && level + 1 < m_embedded->count())
+                    next = m_embedded->level(level + 1);
+                if (next && (next->get_width() != w || next->get_height() != h))
+                    next.clear();
+                m_levels.push_back(next ? next : mip_detail::downsample(m_levels[level]));
+            }
+        }
+        // A wrapper of its own: cairomm's reference count is not atomic, and headless render
+        // threads share one pyramid (see prepare_scene)
+        return Cairo::RefPtr<Cairo::ImageSurface>(new Cairo::ImageSurface(m_levels[level]->cobj(), false));
+    }
+
+    // Bytes held by levels above 0 (level 0 is the frame surface and accounted for with it)
+    size_t extra_bytes() const {
+        size_t bytes = 0;
+        for (size_t i = 1; i < m_levels.size(); ++i)
+            bytes += static_cast<size_t>(m_levels[i]->get_stride()) * m_levels[i]->get_height();
+        return bytes;
+    }
+
+private:
+    std::vector<Cairo::RefPtr<Cairo::ImageSurface>> m_levels;
+    std::shared_ptr<EmbeddedMips> m_embedded;
+};
+
+// Pyramid attached to the frame's pixbuf, like its surface and opacity mask, so frames shared
+// between items share one pyramid and it is freed with the pixels. Main thread only; nullptr for
+// frames without a premultiplied surface.
+inline const Glib::Quark& mip_pyramid_quark() {
+    static const Glib::Quark quark("vs-spredit-mip-pyramid");
+    return quark;
+}
+
+inline MipPyramid* mip_pyramid_for(const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) {
+    const Glib::Quark& quark = mip_pyramid_quark();
+    if (!pixbuf)
+        return nullptr;
+    if (auto* pyramid = static_cast<MipPyramid*>(pixbuf->get_data(quark)))
+        return pyramid;
+    auto surface = premultiplied_surface_for(pixbuf);
+    if (!surface)
+        return nullptr;
+    auto* embedded = static_cast<std::shared_ptr<EmbeddedMips>*>(pixbuf->get_data(embedded_mips_quark()));
+    auto* pyramid = new MipPyramid(surface, embedded ? *embedded : nullptr);
+    pixbuf->set_data(quark, pyramid, [](void* data) { delete static_cast<MipPyramid*>(data); });
+    return pyramid;
+}
+
+// The frame's pyramid if one has been built, without building it (for memory statistics)
+inline const MipPyramid* attached_mip_pyramid(const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) {
+    return pixbuf ? static_cast<const MipPyramid*>(pixbuf->get_data(mip_pyramid_quark())) : nullptr;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 1 bit per pixel: set where the frame's alpha is above a small threshold. Built once per pixbuf
+// (see opacity_mask_for) so click hit-testing is a single bit lookup instead of a pixbuf read.
+class OpacityMask {
+public:
+    static constexpr uint8_t alpha_threshold = 8; // fainter pixels are treated as transparent
+
+    explicit OpacityMask(const Glib::RefPtr<Gdk::Pixbuf>& pixbuf)
+        : m_width(pixbuf->get_width()), m_height(pixbuf->get_height()) {
+        if (!pixbuf->get_has_alpha() || pixbuf->get_n_channels() != 4 || pixbuf->get_bits_per_sample() != 8) {
+            m_all_opaque = true;
+            return;
+        }
+        m_words_per_row = (m_width + 63) / 64;
+        m_bits.assign(static_cast<size_t>(m_words_per_row) * m_height, 0);
+        const guint8* pixels = pixbuf->get_pixels();
+        int stride = pixbuf->get_rowstride();
+        for (int y = 0; y < m_height; ++y)
+            build_row(pixels + static_cast<size_t>(y) * stride, &m_bits[static_cast<size_t>(y) * m_words_per_row]);
+    }
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    bool opaque_at(int x, int y) const {
+        if (x < 0 || y < 0 || x >= m_width || y >= m_height)
+            return false;
+        if (m_all_opaque)
+            return true;
+        uint64_t word = m_bits[static_cast<size_t>(y) * m_words_per_row + x / 64];
+        return (word >> (x % 64)) & 1u;
+    }
+
+    size_t byte_size() const { return m_bits.size() * sizeof(uint64_t); }
+
+private:
+    void build_row(const guint8* rgba, uint64_t* words) const {
+        int x = 0;
+#if defined(__SSE2__)
+        // 16 pixels per step: gather the alpha bytes, compare, and pack the results into 16 bits
+        const __m128i threshold = _mm_set1_epi8(static_cast<char>(alpha_threshold));
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 16 <= m_width; x += 16) {
+            const __m128i* src = reinterpret_cast<const __m128i*>(rgba + x * 4);
+            __m128i a0 = _mm_srli_epi32(_mm_loadu_si128(src + 0), 24);
+            __m128i a1 = _mm_srli_epi32(_mm_loadu_si128(src + 1), 24);
+            __m128i a2 = _mm_srli_epi32(_mm_loadu_si128(src + 2), 24);
+            __m128i a3 = _mm_srli_epi32(_mm_loadu_si128(src + 3), 24);
+            __m128i alpha = _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(a2, a3));
+            // alpha > threshold  <=>  saturating (alpha - threshold) != 0
+            __m128i transparent = _mm_cmpeq_epi8(_mm_subs_epu8(alpha, threshold), zero);
+            uint64_t bits = static_cast<uint16_t>(~_mm_movemask_epi8(transparent));
+            words[x / 64] |= bits << (x % 64);
+        }
+#endif
+        for (; x < m_width; ++x) {
+            if (rgba[x * 4 + 3] > alpha_threshold)
+                words[x / 64] |= uint64_t(1) << (x % 64);
+        }
+    }
+
+    int m_width, m_height;
+    int m_words_per_row = 0;
+    bool m_all_opaque = false;
+    std::vector<uint64_t> m_bits;
+};
+
+// Mask attached to the pixbuf itself, so every item and frame sharing a pixbuf (e.g. uncropped
+// images from ImageCache) shares one mask, and it is freed together with the pixels.
+// Built on first request; loaders call this right after decoding so clicks never pay for it.
+// The mask is built outside the lock, so workers building different masks don't wait on each
+// other; if two threads build the same one, the first attached wins and the other is discarded.
+inline const OpacityMask* opacity_mask_for(const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) {
+    static const Glib::Quark quark("vs-spredit-opacity-mask");
+    static std::mutex attach_mutex; // loader workers may reach the same cached pixbuf at once
+    if (!pixbuf)
+        return nullptr;
+    {
+        std::lock_guard<std::mutex> lock(attach_mutex);
+        if (auto* mask = static_cast<const OpacityMask*>(pixbuf->get_data(quark)))
+            return mask;
+    }
+    auto built = std::make_unique<OpacityMask>(pixbuf);
+    std::lock_guard<std::mutex> lock(attach_mutex);
+    if (auto* mask = static_cast<const OpacityMask*>(pixbuf->get_data(quark)))
+        return mask;
+    auto* mask = built.release();
+    pixbuf->set_data(quark, mask, [](void* data) { delete static_cast<OpacityMask*>(data); });
+    return mask;
+}
@@ -0,0 +1,176 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "atomic_file.h"
+
+namespace fs = std::filesystem;
+
+// Scoped timers and counters for finding out where the editor spends its time. Everything is off
+// until the overlay or a trace turns it on; while off, a perf::Scope costs one relaxed atomic load.
+// When on, each scope updates per-name statistics (read by the overlay) and, while tracing, is
+// also kept as a Chrome trace event ("X" complete events, "C" counters) for chrome://tracing or
+// Perfetto.
+namespace perf {
+
+using Clock = std::chrono::steady_clock;
+
+struct Stat {
+    size_t count = 0;
+    double total_ms = 0;
+    double last_ms = 0;
+    double average_ms = 0; // exponential moving average, so the overlay follows recent frames
+};
+
+class Recorder {
+public:
+    static constexpr size_t max_events = 2'000'000; // ~100 MB of trace; later events are dropped
+
+    static Recorder& instance() {
+        static Recorder recorder;
+        return recorder;
+    }
+
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    void set_overlay(bool on) {
+        m_overlay = on;
+        update_enabled();
+    }
+
+    void start_trace() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tracing = true;
+        m_events.clear();
+        update_enabled();
+    }
+
+    void record(const char* name, const char* category, Clock::time_point start, Clock::time_point end) {
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_stats.find(std::string_view(name));
+        if (it == m_stats.end())
+            it = m_stats.emplace(name, Stat()).first;
+        Stat& stat = it->second;
+        stat.count++;
+        stat.total_ms += ms;
+        stat.last_ms = ms;
+        stat.average_ms = stat.count == 1 ? ms : stat.average_ms * 0.9 + ms * 0.1;
+        if (m_tracing && m_events.size() < max_events)
+            m_events.push_back({name, category, 'X', micros(start), ms * 1000.0, thread_number()});
+    }
+
+    // Latest value of a quantity (items drawn, bytes resident); a "C" event while tracing
+    void counter(const char* name, double value) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_counters.find(std::string_view(name));
+        if (it == m_counters.end())
+            m_counters.emplace(name, value);
+        else
+            it->second = value;
+        if (m_tracing && m_events.size() < max_events)
+            m_events.push_back({name, "counter", 'C', micros(Clock::now()), value, thread_number()});
+    }
+
+    Stat stat(std::string_view name) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_stats.find(name);
+        return it == m_stats.end() ? Stat() : it->second;
+    }
+
+    double counter_value(std::string_view name) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_counters.find(name);
+        return it == m_counters.end() ? 0 : it->second;
+    }
+
+    // Writes the events recorded since start_trace() as Chrome trace-event JSON
+    bool write_trace(const fs::path& path) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        AtomicFileWriter writer(path);
+        std::ostream& out = writer.stream();
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        for (size_t i = 0; i < m_events.size(); ++i) {
+            const Event& e = m_events[i];
+            out << "{\"name\":\"" << e.name << "\",\"cat\":\"" << e.category << "\",\"ph\":\"" << e.phase
+                << "\",\"pid\":1,\"tid\":" << e.thread << ",\"ts\":" << std::fixed << e.timestamp_us;
+            if (e.phase == 'X')
+                out << ",\"dur\":" << e.value;
+            else
+                out << ",\"args\":{\"value\":" << e.value << "}";
+            out << std::defaultfloat << "}" << (i + 1 < m_events.size() ? ",\n" : "\n");
+        }
+        out << "]}\n";
+        return writer.commit();
+    }
+
+    size_t event_count() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_events.size();
+    }
+
+private:
+    // Names and categories are string literals, so events store the pointers
+    struct Event {
+        const char* name;
+        const char* category;
+        char phase;
+        double timestamp_us;
+        double value; // duration in us for 'X', the counter value for 'C'
+        unsigned thread;
+    };
+
+    void update_enabled() { m_enabled.store(m_overlay || m_tracing, std::memory_order_relaxed); }
+
+    double micros(Clock::time_point t) const {
+        return std::chrono::duration<double, std::micro>(t - m_epoch).count();
+    }
+
+    // Small stable thread numbers read better in trace viewers than hashed thread ids
+    static unsigned thread_number() {
+        static std::atomic<unsigned> next{1};
+        thread_local unsigned number = next++;
+        return number;
+    }
+
+    std::atomic<bool> m_enabled{false};
+    bool m_overlay = false;
+    bool m_tracing = false;
+    Clock::time_point m_epoch = Clock::now();
+    mutable std::mutex m_mutex;
+    std::map<std::string, Stat, std::less<>> m_stats;       // transparent, so lookups don't allocate
+    std::map<std::string, double, std::less<>> m_counters;
+    std::vector<Event> m_events;
+};
+
+// Times the enclosing block under `name` (a string literal) when instrumentation is on
+class Scope {
+public:
+    explicit Scope(const char* name, const char* category = "editor") : m_name(name), m_category(category) {
+        if (Recorder::instance().enabled())
+            m_start = Clock::now();
+    }
+    ~Scope() {
+        if (m_start != Clock::time_point())
+            Recorder::instance().record(m_name, m_category, m_start, Clock::now());
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* m_name;
+    const char* m_category;
+    Clock::time_point m_start{};
+};
+
+inline void counter(const char* name, double value) {
+    if (Recorder::instance().enabled())
+        Recorder::instance().counter(name, value);
+}
+
+} // namespace perf
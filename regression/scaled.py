@@ -0,0 +1,6 @@
+# Written by vs_spredit. Canvas 64x64; positions are Vega Strike screen units (-1..1, y up).
+import Base
+
+room = Base.Room('scaled')
+Base.Texture(room, 'tex0', 'fade_back.png', 0.25, -0.25)  # scale 2 2
+Base.Texture(room, 'tex1', 'fade.ani', -0.25, 0.25)  # scale 0.5 0.5
@@ -0,0 +1,134 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "image_item.h"
+#include "perf_trace.h"
+
+// Paints a frame's own premultiplied surface into the box b (canvas units), scaling it with cairo
+inline void paint_frame_direct(const Cairo::RefPtr<Cairo::Context>& cr, const Glib::RefPtr<Gdk::Pixbuf>& frame,
+                               const ItemBounds& b, Cairo::Filter filter = Cairo::FILTER_GOOD) {
+    auto source = premultiplied_surface_for(frame);
+    if (!source)
+        return;
+    cr->save();
+    cr->translate(b.left, b.top);
+    cr->scale(b.width / frame->get_width(), b.height / frame->get_height());
+    auto pattern = Cairo::SurfacePattern::create(source);
+    pattern->set_filter(filter);
+    cr->set_source(pattern);
+    cr->paint();
+    cr->restore();
+}
+
+// Paints the items in order (first is at the back) onto cr, whose user space is canvas
+// coordinates (origin at the canvas centre) scaled by view_zoom. Items outside the current clip are
+// skipped. Each item's drawn_bounds is updated for damage tracking. Returns the number of items
+// actually painted.
+inline size_t draw_items(const Cairo::RefPtr<Cairo::Context>& cr, const std::vector<std::shared_ptr<ImageItem>>& images,
+                         double view_zoom = 1.0) {
+    double clip_x1, clip_y1, clip_x2, clip_y2;
+    cr->get_clip_extents(clip_x1, clip_y1, clip_x2, clip_y2);
+
+    auto target = cr->get_target();
+    size_t painted = 0;
+    for (const auto& img : images) {
+        ItemBounds b = img->bounds(img->current_frame);
+        img->drawn_bounds = b;
+        if (!b.intersects(clip_x1, clip_y1, clip_x2, clip_y2)) continue;
+
+        Cairo::RefPtr<Cairo::ImageSurface> scaled;
+        {
+            perf::Scope timer("scale_item", "draw");
+            scaled = img->get_scaled_surface(img->current_frame, target, view_zoom);
+        }
+        perf::Scope paint_timer("paint_item", "draw");
+        if (scaled) {
+            if (view_zoom == 1.0) {
+                cr->set_source(scaled, b.left, b.top);
+                cr->paint();
+            } else {
+                // Already at screen resolution: undo the zoom so it lands 1:1 on device pixels
+                cr->save();
+                cr->translate(b.left, b.top);
+                cr->scale(1.0 / view_zoom, 1.0 / view_zoom);
+                cr->set_source(scaled, 0, 0);
+                cr->paint();
+                cr->restore();
+            }
+        } else {
+            // Magnified: sample the frame's own pixels, as hard-edged squares once each covers
+            // two screen pixels so they can be inspected
+            auto frame = img->get_frame(img->current_frame);
+            if (!frame) continue;
+            paint_frame_direct(cr, frame, b, view_zoom >= 2.0 ? Cairo::FILTER_NEAREST : Cairo::FILTER_GOOD);
+        }
+        painted++;
+
+        if (img->selected) {
+            cr->set_source_rgb(1.0, 0.0, 0.0);
+            cr->set_line_width(2 / view_zoom);
+            cr->rectangle(b.left, b.top, b.width, b.height);
+            cr->stroke();
+        }
+    }
+    return painted;
+}
+
+// --- Headless rendering ---
+struct RenderOptions {
+    int width = 800, height = 600;  // Output size; the canvas origin is at its centre
+    double zoom = 1.0;
+    uint32_t background = 0;        // Straight-alpha 0xRRGGBBAA; 0 leaves the image transparent
+};
+
+// Copies of the items for one rendering thread. Frames and their surfaces are shared, but each
+// copy keeps its own current_frame, drawn_bounds and scaled copies, so draw_items can run on
+// several copies of a scene at once. Selection outlines are dropped.
+inline std::vector<std::shared_ptr<ImageItem>> copy_scene(const std::vector<std::shared_ptr<ImageItem>>& images) {
+    std::vector<std::shared_ptr<ImageItem>> copies;
+    copies.reserve(images.size());
+    for (const auto& img : images) {
+        auto copy = std::make_shared<ImageItem>(*img);
+        copy->selected = false;
+        copy->invalidate_scaled_cache();
+        copy->cached_scale_x = copy->cached_scale_y = 0;
+        copies.push_back(copy);
+    }
+    return copies;
+}
+
+// Renders the scene as it looks time_ms after every animation started, into a new image surface,
+// without a display. It draws through draw_items, as the canvas does, so the output matches the
+// editor at the same zoom: scaled copies, mip levels and the magnified-pixel filter included.
+// That sets each item's current_frame and fills its scaled copies, so threads rendering the same
+// scene each need their own copy_scene; frames must be fully decoded (no lazy_frames), and their
+// mip pyramids already built for the scales drawn (see prepare_scene).
+inline Cairo::RefPtr<Cairo::ImageSurface> render_scene(const std::vector<std::shared_ptr<ImageItem>>& images,
+                                                       double time_ms, const RenderOptions& options = {}) {
+    auto surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, options.width, options.height);
+    auto cr = Cairo::Context::create(surface);
+    if (options.background) {
+        cr->set_source_rgba(((options.background >> 24) & 0xff) / 255.0, ((options.background >> 16) & 0xff) / 255.0,
+                            ((options.background >> 8) & 0xff) / 255.0, (options.background & 0xff) / 255.0);
+        cr->paint();
+    }
+    cr->translate(options.width / 2.0, options.height / 2.0);
+    cr->scale(options.zoom, options.zoom);
+    for (const auto& img : images)
+        img->current_frame = img->frame_at(time_ms);
+    draw_items(cr, images, options.zoom);
+    surface->flush();
+    return surface;
+}
+
+// Attaches every frame's surface and builds the mip levels render_scene will use at this zoom, on
+// the calling thread, so that threads rendering copies of the scene afterwards only read them
+inline void prepare_scene(const std::vector<std::shared_ptr<ImageItem>>& images, double zoom) {
+    for (const auto& img : copy_scene(images)) {
+        for (size_t i = 0; i < img->frame_count(); ++i) {
+            premultiplied_surface_for(img->get_frame(i)); // magnified frames are painted from it
+            img->get_scaled_surface(i, {}, zoom);
+        }
+    }
+}
@@ -0,0 +1,409 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "async_spr_loader.h"
+#include "atomic_file.h"
+#include "image_item.h"
+#include "mapped_file.h"
+
+// Binary cache of a saved layout, written next to it as <layout>.vssnap. It holds everything needed
+// to rebuild the scene without touching the .spr files: item placement and order, the sprite
+// header fields and parsed frame lists, and (unless the frames were still loading or decode
+// lazily) each frame's pixels twice, as straight RGBA for the pixbuf and as premultiplied ARGB32
+// for Cairo. Pixel blocks are 64-byte aligned and used in place from a read-only mapping, so
+// reopening decodes nothing and only touches the pages that get drawn.
+//
+// The snapshot lists every file it was built from with its mtime and size; if any of them changed
+// it is ignored and the layout is loaded normally. Fields are in host byte order; a snapshot from a
+// machine with a different byte order is rejected, as is any other version.
+
+inline fs::path snapshot_path_for(const fs::path& layout_path) {
+    return layout_path.string() + ".vssnap";
+}
+
+namespace snapshot_detail {
+
+constexpr char magic[8] = {'V', 'S', 'S', 'N', 'A', 'P', '\0', '\1'};
+constexpr uint32_t version = 1;
+constexpr uint32_t byte_order_mark = 0x01020304;
+constexpr uint64_t pixel_alignment = 64;
+// magic, version, byte order mark, metadata size, pixel base
+constexpr size_t header_size = sizeof(magic) + 4 + 4 + 8 + 8;
+
+inline uint64_t align(uint64_t v) {
+    return (v + pixel_alignment - 1) / pixel_alignment * pixel_alignment;
+}
+
+struct Encoder {
+    std::string out;
+
+    template <typename T>
+    void put(T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void put_string(const std::string& s) {
+        put<uint32_t>(static_cast<uint32_t>(s.size()));
+        out += s;
+    }
+};
+
+struct Decoder {
+    std::string_view data;
+    size_t pos = 0;
+    bool ok = true;
+
+    template <typename T>
+    T get() {
+        T value{};
+        if (pos + sizeof(T) > data.size()) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, data.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+    std::string get_string() {
+        uint32_t size = get<uint32_t>();
+        if (!ok || pos + size > data.size()) {
+            ok = false;
+            return {};
+        }
+        std::string s(data.substr(pos, size));
+        pos += size;
+        return s;
+    }
+};
+
+struct FileStamp {
+    int64_t mtime = 0;
+    uint64_t size = 0;
+};
+
+inline bool stamp_of(const fs::path& path, FileStamp& stamp) {
+    std::error_code ec;
+    auto mtime = fs::last_write_time(path, ec);
+    if (ec) return false;
+    auto size = fs::file_size(path, ec);
+    if (ec) return false;
+    stamp.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+    stamp.size = size;
+    return true;
+}
+
+struct FrameRecord {
+    uint32_t width = 0, height = 0, channels = 0;
+    uint32_t rgba_stride = 0, argb_stride = 0;
+    uint64_t rgba_offset = 0, argb_offset = 0; // relative to the pixel base until written
+};
+
+// Whether a record read back from a file describes pixels that lie wholly inside it, with rows at
+// least as long as the pixbuf and surface made over them will read. Sizes must fit in int.
+inline bool record_valid(const FrameRecord& r, uint64_t file_size) {
+    constexpr uint32_t int_max = static_cast<uint32_t>(std::numeric_limits<int>::max());
+    if ((r.channels != 3 && r.channels != 4) || r.width == 0 || r.height == 0 || r.width > int_max / 4 ||
+        r.height > int_max || r.rgba_stride > int_max || r.argb_stride > int_max)
+        return false;
+    if (r.rgba_stride < r.width * r.channels ||
+        r.argb_stride < static_cast<uint32_t>(Cairo::ImageSurface::format_stride_for_width(Cairo::FORMAT_ARGB32, static_cast<int>(r.width))))
+        return false;
+    auto fits = [&](uint64_t offset, uint32_t stride) {
+        return offset <= file_size && uint64_t(stride) * r.height <= file_size - offset;
+    };
+    return fits(r.rgba_offset, r.rgba_stride) && fits(r.argb_offset, r.argb_stride);
+}
+
+inline cairo_user_data_key_t mapping_key;
+
+} // namespace snapshot_detail
+
+// Frames of a restored item, created over the snapshot mapping on first use. The mapping stays
+// alive as long as any pixbuf or surface made from it does.
+class SnapshotFrames : public FrameSource {
+public:
+    SnapshotFrames(std::shared_ptr<MappedFile> file, std::vector<snapshot_detail::FrameRecord> records)
+        : m_file(std::move(file)), m_records(std::move(records)), m_pixbufs(m_records.size()) {}
+
+    size_t size() const override { return m_records.size(); }
+    bool is_resident(size_t) const override { return true; } // paged in and out by the kernel
+    size_t eviction_count() const override { return 0; }
+    Glib::RefPtr<Gdk::Pixbuf> resident(size_t index) const override { return m_pixbufs[index]; }
+
+    Glib::RefPtr<Gdk::Pixbuf> get(size_t index) override {
+        if (m_pixbufs[index])
+            return m_pixbufs[index];
+        const auto& r = m_records[index];
+        auto file = m_file;
+        auto pixbuf = Gdk::Pixbuf::create_from_data(
+            reinterpret_cast<const guint8*>(m_file->data() + r.rgba_offset), Gdk::COLORSPACE_RGB, r.channels == 4, 8,
+            static_cast<int>(r.width), static_cast<int>(r.height), static_cast<int>(r.rgba_stride),
+            [file](const guint8*) {});
+        // Cairo only reads from a source surface, so the read-only mapping is safe to wrap
+        auto surface = Cairo::ImageSurface::create(
+            reinterpret_cast<unsigned char*>(const_cast<char*>(m_file->data() + r.argb_offset)), Cairo::FORMAT_ARGB32,
+            static_cast<int>(r.width), static_cast<int>(r.height), static_cast<int>(r.argb_stride));
+        cairo_surface_set_user_data(surface->cobj(), &snapshot_detail::mapping_key, new std::shared_ptr<MappedFile>(m_file),
+                                    [](void* data) { delete static_cast<std::shared_ptr<MappedFile>*>(data); });
+        attach_surface(pixbuf, surface);
+        m_pixbufs[index] = pixbuf;
+        return pixbuf;
+    }
+
+    void replace(size_t index, const Glib::RefPtr<Gdk::Pixbuf>& pixbuf) override {
+        m_pixbufs[index] = pixbuf;
+    }
+
+private:
+    std::shared_ptr<MappedFile> m_file;
+    std::vector<snapshot_detail::FrameRecord> m_records;
+    std::vector<Glib::RefPtr<Gdk::Pixbuf>> m_pixbufs;
+};
+
+// Writes the snapshot for a layout that has just been saved to layout_path. Returns false (and
+// leaves any previous snapshot in place) on failure.
+inline bool write_scene_snapshot(const std::vector<std::shared_ptr<ImageItem>>& items, const fs::path& layout_path) {
+    using namespace snapshot_detail;
+
+    // Files the scene was built from
+    std::set<fs::path> sources{layout_path};
+    for (const auto& item : items) {
+        if (!item->source_path.empty()) sources.insert(item->source_path);
+        for (const auto& info : item->frame_infos) {
+            sources.insert(info.image_path);
+            if (!info.alpha_mask_path.empty()) sources.insert(info.alpha_mask_path);
+        }
+    }
+
+    // Unique frames to store, in first-use order; items whose frames aren't all ready store none
+    std::vector<Glib::RefPtr<Gdk::Pixbuf>> frames;
+    std::vector<FrameRecord> records;
+    std::map<const Gdk::Pixbuf*, size_t> frame_index;
+    std::vector<std::vector<size_t>> item_frames(items.size());
+    uint64_t pixel_size = 0;
+    for (size_t i = 0; i < items.size(); ++i) {
+        const ImageItem& item = *items[i];
+        if (item.lazy_frames && !dynamic_cast<SnapshotFrames*>(item.lazy_frames.get()))
+            continue; // decoding every frame of a long animation here would defeat the lazy store
+        std::vector<Glib::RefPtr<Gdk::Pixbuf>> item_pixbufs;
+        for (size_t f = 0; f < item.frame_count(); ++f) {
+            auto pixbuf = item.get_frame(f);
+            if (!pixbuf || pixbuf == frame_placeholder() || pixbuf->get_bits_per_sample() != 8) {
+                item_pixbufs.clear();
+                break;
+            }
+            item_pixbufs.push_back(pixbuf);
+        }
+        for (const auto& pixbuf : item_pixbufs) {
+            auto [it, inserted] = frame_index.emplace(pixbuf.operator->(), frames.size());
+            if (inserted) {
+                FrameRecord r;
+                r.width = pixbuf->get_width();
+                r.height = pixbuf->get_height();
+                r.channels = pixbuf->get_n_channels();
+                r.rgba_stride = r.width * r.channels;
+                r.argb_stride = Cairo::ImageSurface::format_stride_for_width(Cairo::FORMAT_ARGB32, r.width);
+                r.rgba_offset = pixel_size;
+                pixel_size = align(pixel_size + uint64_t(r.rgba_stride) * r.height);
+                r.argb_offset = pixel_size;
+                pixel_size = align(pixel_size + uint64_t(r.argb_stride) * r.height);
+                frames.push_back(pixbuf);
+                records.push_back(r);
+            }
+            item_frames[i].push_back(it->second);
+        }
+    }
+
+    Encoder meta;
+    meta.put<uint32_t>(static_cast<uint32_t>(sources.size()));
+    for (const auto& source : sources) {
+        FileStamp stamp;
+        if (!stamp_of(source, stamp)) {
+            std::cerr << "Warning: not writing a snapshot; cannot stat " << source << std::endl;
+            return false;
+        }
+        meta.put_string(source.string());
+        meta.put<int64_t>(stamp.mtime);
+        meta.put<uint64_t>(stamp.size);
+    }
+    meta.put<uint32_t>(static_cast<uint32_t>(items.size()));
+    for (size_t i = 0; i < items.size(); ++i) {
+        const ImageItem& item = *items[i];
+        meta.put_string(item.source_path.string());
+        meta.put<double>(item.x);
+        meta.put<double>(item.y);
+        meta.put<double>(item.scale_x);
+        meta.put<double>(item.scale_y);
+        meta.put<double>(item.frame_delay_ms);
+        meta.put<uint8_t>(item.is_animation);
+        meta.put<uint8_t>(item.has_static_alpha_mask);
+        meta.put_string(item.static_image_filepath.string());
+        meta.put_string(item.alpha_mask_filepath.string());
+
+        // Plain images have no frame list; store one so the fallback path can decode them
+        std::vector<ParsedFrameInfo> infos = item.frame_infos;
+        if (infos.empty() && !item.source_path.empty())
+            infos.push_back(ParsedFrameInfo{item.source_path});
+        meta.put<uint32_t>(static_cast<uint32_t>(infos.size()));
+        for (const auto& info : infos) {
+            meta.put_string(info.image_path.string());
+            meta.put_string(info.alpha_mask_path.string());
+            meta.put<uint8_t>(info.has_alpha_mask_in_frame_line);
+            meta.put<uint8_t>(info.has_cropping);
+            meta.put<double>(info.mins);
+            meta.put<double>(info.mint);
+            meta.put<double>(info.maxs);
+            meta.put<double>(info.maxt);
+        }
+
+        meta.put<uint32_t>(static_cast<uint32_t>(item_frames[i].size())); // 0: decode from the frame list
+        for (size_t f : item_frames[i]) {
+            const FrameRecord& r = records[f];
+            meta.put<uint32_t>(r.width);
+            meta.put<uint32_t>(r.height);
+            meta.put<uint32_t>(r.channels);
+            meta.put<uint32_t>(r.rgba_stride);
+            meta.put<uint32_t>(r.argb_stride);
+            meta.put<uint64_t>(r.rgba_offset);
+            meta.put<uint64_t>(r.argb_offset);
+        }
+    }
+
+    uint64_t pixel_base = align(header_size + meta.out.size());
+    AtomicFileWriter writer(snapshot_path_for(layout_path), 1 << 20);
+    std::ostream& out = writer.stream();
+    out.write(magic, sizeof(magic));
+    Encoder header;
+    header.put<uint32_t>(version);
+    header.put<uint32_t>(byte_order_mark);
+    header.put<uint64_t>(meta.out.size());
+    header.put<uint64_t>(pixel_base);
+    out << header.out << meta.out;
+
+    uint64_t written = header_size + meta.out.size();
+    auto pad_to = [&](uint64_t offset) {
+        for (; written < offset; ++written)
+            out.put('\0');
+    };
+    for (size_t f = 0; f < frames.size(); ++f) {
+        const auto& pixbuf = frames[f];
+        const FrameRecord& r = records[f];
+        pad_to(pixel_base + r.rgba_offset);
+        const guint8* pixels = pixbuf->get_pixels();
+        for (uint32_t y = 0; y < r.height; ++y)
+            out.write(reinterpret_cast<const char*>(pixels + size_t(y) * pixbuf->get_rowstride()), r.rgba_stride);
+        written += uint64_t(r.rgba_stride) * r.height;
+
+        pad_to(pixel_base + r.argb_offset);
+        auto surface = premultiplied_surface_for(pixbuf);
+        surface->flush();
+        out.write(reinterpret_cast<const char*>(surface->get_data()), std::streamsize(r.argb_stride) * r.height);
+        written += uint64_t(r.argb_stride) * r.height;
+    }
+    return writer.commit();
+}
+
+// Rebuilds the scene saved with layout_path from its snapshot. Returns false, leaving `items`
+// empty, if there is no snapshot or it is stale or unreadable; the caller then loads the layout.
+// Items without stored pixels are decoded through start_frame_decodes, like a fresh load.
+inline bool read_scene_snapshot(const fs::path& layout_path, FrameLoader& loader, const FrameReadyFn& on_frame_ready,
+                                std::vector<std::shared_ptr<ImageItem>>& items) {
+    using namespace snapshot_detail;
+    items.clear();
+    auto file = std::make_shared<MappedFile>(snapshot_path_for(layout_path).string());
+    if (!file->is_open() || file->size() < header_size || std::memcmp(file->data(), magic, sizeof(magic)) != 0)
+        return false;
+
+    Decoder in{file->view(), sizeof(magic)};
+    if (in.get<uint32_t>() != version || in.get<uint32_t>() != byte_order_mark) {
+        std::cerr << "Warning: ignoring snapshot of " << layout_path << " from another version or machine." << std::endl;
+        return false;
+    }
+    uint64_t meta_size = in.get<uint64_t>();
+    uint64_t pixel_base = in.get<uint64_t>();
+    if (!in.ok || header_size + meta_size > file->size() || pixel_base > file->size())
+        return false;
+    in.data = in.data.substr(0, header_size + meta_size);
+
+    uint32_t source_count = in.get<uint32_t>();
+    for (uint32_t i = 0; i < source_count && in.ok; ++i) {
+        fs::path source = in.get_string();
+        FileStamp saved{in.get<int64_t>(), in.get<uint64_t>()}, current;
+        if (in.ok && (!stamp_of(source, current) || current.mtime != saved.mtime || current.size != saved.size)) {
+            std::cout << "Snapshot of " << layout_path << " is out of date (" << source << " changed)." << std::endl;
+            return false;
+        }
+    }
+
+    uint32_t item_count = in.get<uint32_t>();
+    std::vector<std::shared_ptr<ImageItem>> restored;
+    for (uint32_t i = 0; i < item_count && in.ok; ++i) {
+        auto item = std::make_shared<ImageItem>();
+        item->source_path = in.get_string();
+        item->x = in.get<double>();
+        item->y = in.get<double>();
+        item->scale_x = in.get<double>();
+        item->scale_y = in.get<double>();
+        item->frame_delay_ms = in.get<double>();
+        item->is_animation = in.get<uint8_t>();
+        item->has_static_alpha_mask = in.get<uint8_t>();
+        item->static_image_filepath = in.get_string();
+        item->alpha_mask_filepath = in.get_string();
+
+        uint32_t info_count = in.get<uint32_t>();
+        std::vector<ParsedFrameInfo> infos;
+        for (uint32_t f = 0; f < info_count && in.ok; ++f) {
+            ParsedFrameInfo& info = infos.emplace_back();
+            info.image_path = in.get_string();
+            info.alpha_mask_path = in.get_string();
+            info.has_alpha_mask_in_frame_line = in.get<uint8_t>();
+            info.has_cropping = in.get<uint8_t>();
+            info.mins = in.get<double>();
+            info.mint = in.get<double>();
+            info.maxs = in.get<double>();
+            info.maxt = in.get<double>();
+        }
+        item->frame_infos = infos;
+
+        uint32_t frame_count = in.get<uint32_t>();
+        std::vector<FrameRecord> records;
+        for (uint32_t f = 0; f < frame_count && in.ok; ++f) {
+            FrameRecord r;
+            r.width = in.get<uint32_t>();
+            r.height = in.get<uint32_t>();
+            r.channels = in.get<uint32_t>();
+            r.rgba_stride = in.get<uint32_t>();
+            r.argb_stride = in.get<uint32_t>();
+            uint64_t rgba_offset = in.get<uint64_t>(), argb_offset = in.get<uint64_t>();
+            // Offsets past the file are rejected before adding, so the sum can't wrap
+            r.rgba_offset = rgba_offset <= file->size() ? pixel_base + rgba_offset : UINT64_MAX;
+            r.argb_offset = argb_offset <= file->size() ? pixel_base + argb_offset : UINT64_MAX;
+            if (!record_valid(r, file->size()))
+                in.ok = false;
+            records.push_back(r);
+        }
+        if (!in.ok)
+            break;
+
+        if (!records.empty()) {
+            item->lazy_frames = std::make_shared<SnapshotFrames>(file, std::move(records));
+        } else if (!start_frame_decodes(item, infos, loader, on_frame_ready)) {
+            continue; // already reported; same as a failed load of that sprite
+        }
+        restored.push_back(item);
+    }
+    if (!in.ok) {
+        std::cerr << "Warning: snapshot of " << layout_path << " is damaged; loading the layout instead." << std::endl;
+        return false;
+    }
+    items = std::move(restored);
+    return true;
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "image_item.h"
+
+// Uniform grid over canvas space mapping cells to the items whose bounds overlap them.
+// Updates touch only the cells an item enters or leaves, and queries only the cells under the
+// query rectangle, so both scale with local density rather than scene size. Items covering more
+// than max_item_cells cells (a backdrop scaled up 1000x) go on an oversized list that every query
+// returns instead, so no item costs more than a handful of cell entries.
+class SpatialGrid {
+public:
+    static constexpr int64_t max_item_cells = 16;
+    static constexpr int max_cell_coord = 1 << 20; // cells beyond +-2^28 px at 256 px/cell are clamped
+
+    explicit SpatialGrid(double cell_size = 256.0) : m_cell_size(cell_size) {}
+
+    // Insert the item or move it to its new bounds; empty bounds remove it
+    void update(const ImageItem* item, const ItemBounds& b) {
+        if (b.empty()) {
+            remove(item);
+            return;
+        }
+        CellRange range = cells_for(b.left, b.top, b.left + b.width, b.top + b.height);
+        auto it = m_items.find(item);
+        if (it != m_items.end()) {
+            if (it->second == range)
+                return;
+            unlink(item, it->second);
+            it->second = range;
+        } else {
+            m_items.emplace(item, range);
+        }
+        if (range.oversized())
+            m_oversized.push_back(item);
+        else
+            for_each_cell(range, [&](uint64_t key) { m_cells[key].push_back(item); });
+    }
+
+    void remove(const ImageItem* item) {
+        auto it = m_items.find(item);
+        if (it == m_items.end())
+            return;
+        unlink(item, it->second);
+        m_items.erase(it);
+    }
+
+    void clear() {
+        m_cells.clear();
+        m_items.clear();
+        m_oversized.clear();
+    }
+
+    // Items whose cells overlap the rectangle, plus every oversized item, without duplicates.
+    // Callers still test exact bounds.
+    void query(double x1, double y1, double x2, double y2, std::vector<const ImageItem*>& out) const {
+        out.clear();
+        CellRange range = cells_for(x1, y1, x2, y2);
+        if (range.cell_count() > static_cast<int64_t>(m_cells.size())) {
+            // Zoomed far out: fewer occupied cells than cells under the rectangle
+            for (const auto& [key, items] : m_cells) {
+                int cx = static_cast<int32_t>(key >> 32), cy = static_cast<int32_t>(key & 0xffffffffu);
+                if (cx >= range.x1 && cx <= range.x2 && cy >= range.y1 && cy <= range.y2)
+                    out.insert(out.end(), items.begin(), items.end());
+            }
+        } else {
+            for_each_cell(range, [&](uint64_t key) {
+                auto cell = m_cells.find(key);
+                if (cell != m_cells.end())
+                    out.insert(out.end(), cell->second.begin(), cell->second.end());
+            });
+        }
+        out.insert(out.end(), m_oversized.begin(), m_oversized.end());
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+private:
+    struct CellRange {
+        int x1, y1, x2, y2; // inclusive
+        bool operator==(const CellRange& o) const { return x1 == o.x1 && y1 == o.y1 && x2 == o.x2 && y2 == o.y2; }
+        int64_t cell_count() const { return (int64_t(x2) - x1 + 1) * (int64_t(y2) - y1 + 1); }
+        bool oversized() const { return cell_count() > max_item_cells; }
+    };
+
+    CellRange cells_for(double x1, double y1, double x2, double y2) const {
+        return {cell_coord(x1), cell_coord(y1), cell_coord(x2), cell_coord(y2)};
+    }
+
+    // Clamped before the cast, which is undefined for values outside int (and NaN)
+    int cell_coord(double v) const {
+        double c = std::floor(v / m_cell_size);
+        if (!(c > -max_cell_coord))
+            return -max_cell_coord;
+        return static_cast<int>(std::min<double>(c, max_cell_coord));
+    }
+
+    static uint64_t cell_key(int cx, int cy) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cy);
+    }
+
+    template <typename Fn>
+    static void for_each_cell(const CellRange& r, Fn&& fn) {
+        for (int cy = r.y1; cy <= r.y2; ++cy)
+            for (int cx = r.x1; cx <= r.x2; ++cx)
+                fn(cell_key(cx, cy));
+    }
+
+    void unlink(const ImageItem* item, const CellRange& range) {
+        if (range.oversized())
+            m_oversized.erase(std::remove(m_oversized.begin(), m_oversized.end(), item), m_oversized.end());
+        else
+            for_each_cell(range, [&](uint64_t key) { erase_from_cell(key, item); });
+    }
+
+    void erase_from_cell(uint64_t key, const ImageItem* item) {
+        auto cell = m_cells.find(key);
+        if (cell == m_cells.end())
+            return;
+        auto& items = cell->second;
+        items.erase(std::remove(items.begin(), items.end(), item), items.end());
+        if (items.empty())
+            m_cells.erase(cell);
+    }
+
+    double m_cell_size;
+    std::unordered_map<uint64_t, std::vector<const ImageItem*>> m_cells;
+    std::unordered_map<const ImageItem*, CellRange> m_items;
+    std::vector<const ImageItem*> m_oversized;
+};
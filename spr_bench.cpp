@@ -0,0 +1,223 @@
+// Benchmarks for the loader and renderer hot paths. Generates synthetic PNG frames, a sprite-sheet
+// atlas and matching .ani files, then times parsing, decoding, cropping, scaling and an offscreen
+// draw_items pass. Results are printed as JSON with a fixed key order so runs can be diffed.
+//
+//   spr_bench [--frames N] [--size PX] [--items N] [--iterations N] [--out DIR]
+#include <gtkmm.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "image_item.h"
+#include "spr_parser.h"
+#include "scene_renderer.h"
+
+struct BenchConfig {
+    int frames = 16;
+    int size = 256;
+    int items = 40;
+    int iterations = 20;
+    fs::path out_dir = fs::temp_directory_path() / "spr_bench";
+};
+
+struct BenchResult {
+    std::string name;
+    std::vector<double> samples_ms;
+};
+
+template <typename Fn>
+BenchResult run_bench(const std::string& name, int iterations, Fn&& fn) {
+    BenchResult result{name, {}};
+    for (int i = 0; i < iterations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fn(i);
+        result.samples_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return result;
+}
+
+// Opaque-ish gradient with a moving alpha disc so frames differ and exercise blending
+Glib::RefPtr<Gdk::Pixbuf> make_frame(int size, int frame, int frame_count) {
+    auto pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, size, size);
+    guint8* pixels = pixbuf->get_pixels();
+    int stride = pixbuf->get_rowstride();
+    double cx = size * (0.25 + 0.5 * frame / std::max(1, frame_count - 1));
+    double cy = size / 2.0;
+    double radius = size / 3.0;
+    for (int y = 0; y < size; ++y) {
+        guint8* row = pixels + static_cast<size_t>(y) * stride;
+        for (int x = 0; x < size; ++x) {
+            double d = std::hypot(x - cx, y - cy);
+            row[x * 4 + 0] = static_cast<guint8>(255 * x / size);
+            row[x * 4 + 1] = static_cast<guint8>(255 * y / size);
+            row[x * 4 + 2] = static_cast<guint8>(255 * frame / std::max(1, frame_count));
+            row[x * 4 + 3] = d < radius ? 255 : static_cast<guint8>(std::max(0.0, 255 - (d - radius) * 4));
+        }
+    }
+    return pixbuf;
+}
+
+// Writes frame_N.png, atlas.png, frames.ani (one file per frame) and atlas.ani (crops of atlas.png)
+void write_fixtures(const BenchConfig& config) {
+    fs::create_directories(config.out_dir);
+    int columns = static_cast<int>(std::ceil(std::sqrt(config.frames)));
+    int rows = (config.frames + columns - 1) / columns;
+    auto atlas = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, columns * config.size, rows * config.size);
+    atlas->fill(0x00000000);
+
+    std::ofstream frames_ani(config.out_dir / "frames.ani");
+    std::ofstream atlas_ani(config.out_dir / "atlas.ani");
+    for (auto* ani : {&frames_ani, &atlas_ani}) {
+        *ani << config.size << " " << config.size << "\n"
+             << config.size << " " << config.size << "\n"
+             << config.frames << " 100\n";
+    }
+
+    for (int i = 0; i < config.frames; ++i) {
+        auto frame = make_frame(config.size, i, config.frames);
+        std::string name = "frame_" + std::to_string(i) + ".png";
+        frame->save((config.out_dir / name).string(), "png");
+        frames_ani << name << "\n";
+
+        int col = i % columns, row = i / columns;
+        frame->copy_area(0, 0, config.size, config.size, atlas, col * config.size, row * config.size);
+        atlas_ani << "atlas.png mins=" << double(col) / columns << ",mint=" << double(row) / rows
+                  << ",maxs=" << double(col + 1) / columns << ",maxt=" << double(row + 1) / rows << "\n";
+    }
+    atlas->save((config.out_dir / "atlas.png").string(), "png");
+}
+
+std::string read_file(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+std::shared_ptr<ImageItem> load_or_die(const fs::path& path, const fs::path& root) {
+    auto item = load_spr_file(path.string(), root);
+    if (!item || item->frames.empty()) {
+        std::cerr << "Error: could not load fixture " << path << std::endl;
+        std::exit(1);
+    }
+    return item;
+}
+
+void print_results(const BenchConfig& config, const std::vector<BenchResult>& results) {
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "{\n  \"config\": {\"frames\": " << config.frames << ", \"size\": " << config.size
+              << ", \"items\": " << config.items << ", \"iterations\": " << config.iterations << "},\n"
+              << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto samples = results[i].samples_ms;
+        std::sort(samples.begin(), samples.end());
+        double total = 0;
+        for (double s : samples) total += s;
+        std::cout << "    {\"name\": \"" << results[i].name << "\", \"iterations\": " << samples.size()
+                  << ", \"mean_ms\": " << total / samples.size() << ", \"median_ms\": " << samples[samples.size() / 2]
+                  << ", \"min_ms\": " << samples.front() << ", \"max_ms\": " << samples.back() << "}"
+                  << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "  ]\n}" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next_int = [&](int& value) {
+            if (i + 1 < argc) value = std::max(1, std::atoi(argv[++i]));
+        };
+        if (arg == "--frames") next_int(config.frames);
+        else if (arg == "--size") next_int(config.size);
+        else if (arg == "--items") next_int(config.items);
+        else if (arg == "--iterations") next_int(config.iterations);
+        else if (arg == "--out" && i + 1 < argc) config.out_dir = argv[++i];
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--frames N] [--size PX] [--items N] [--iterations N] [--out DIR]" << std::endl;
+            return 2;
+        }
+    }
+
+    Gtk::Main::init_gtkmm_internals();
+    write_fixtures(config);
+
+    // Keep the parser's progress chatter out of the JSON
+    std::vector<SprDiagnostic> diagnostics;
+    spr_diagnostic_sink = &diagnostics;
+
+    const fs::path& root = config.out_dir;
+    fs::path frames_ani = root / "frames.ani";
+    fs::path atlas_ani = root / "atlas.ani";
+    std::string frames_ani_text = read_file(frames_ani);
+    std::vector<BenchResult> results;
+
+    results.push_back(run_bench("parse_buffer", config.iterations, [&](int) {
+        ImageItem item;
+        std::vector<ParsedFrameInfo> infos;
+        parse_spr_buffer(frames_ani_text, frames_ani.string(), root, item, infos);
+    }));
+    results.push_back(run_bench("parse_file", config.iterations, [&](int) {
+        ImageItem item;
+        std::vector<ParsedFrameInfo> infos;
+        parse_spr_file(frames_ani.string(), root, item, infos);
+    }));
+
+    ImageItem frames_item, atlas_item;
+    std::vector<ParsedFrameInfo> frame_infos, atlas_infos;
+    parse_spr_file(frames_ani.string(), root, frames_item, frame_infos);
+    parse_spr_file(atlas_ani.string(), root, atlas_item, atlas_infos);
+
+    results.push_back(run_bench("decode_frames", config.iterations, [&](int) {
+        ImageCache::instance().clear();
+        for (const auto& info : frame_infos) decode_frame(info);
+    }));
+    results.push_back(run_bench("decode_atlas", config.iterations, [&](int) {
+        ImageCache::instance().clear();
+        for (const auto& info : atlas_infos) decode_frame(info);
+    }));
+    results.push_back(run_bench("crop_atlas", config.iterations, [&](int) {
+        // Atlas stays cached: this is the cost of the crop views alone
+        for (const auto& info : atlas_infos) decode_frame(info);
+    }));
+
+    auto item = load_or_die(frames_ani, root);
+    item->scale_x = item->scale_y = 0.75;
+    results.push_back(run_bench("scale_frames", config.iterations, [&](int) {
+        item->invalidate_scaled_cache();
+        for (size_t f = 0; f < item->frame_count(); ++f) item->get_scaled_surface(f);
+    }));
+
+    // Scene of `items` copies laid out on a grid, all sharing the decoded frames
+    int columns = static_cast<int>(std::ceil(std::sqrt(config.items)));
+    int rows = (config.items + columns - 1) / columns;
+    int cell = config.size * 3 / 4;
+    std::vector<std::shared_ptr<ImageItem>> scene;
+    for (int i = 0; i < config.items; ++i) {
+        auto copy = std::make_shared<ImageItem>();
+        copy->frames = item->frames;
+        copy->frame_delay_ms = item->frame_delay_ms;
+        copy->scale_x = copy->scale_y = 0.75;
+        copy->x = (i % columns - (columns - 1) / 2.0) * cell;
+        copy->y = (i / columns - (rows - 1) / 2.0) * cell;
+        copy->current_frame = i;
+        scene.push_back(copy);
+    }
+    auto surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, columns * cell, rows * cell);
+    auto render_frame = [&](int) {
+        auto cr = Cairo::Context::create(surface);
+        cr->set_source_rgb(0, 0, 0);
+        cr->paint();
+        cr->translate(columns * cell / 2.0, rows * cell / 2.0);
+        for (auto& img : scene) img->current_frame++;
+        draw_items(cr, scene);
+        surface->flush();
+    };
+    for (size_t f = 0; f < item->frame_count(); ++f) render_frame(0); // warm the scaled caches
+    results.push_back(run_bench("draw_scene", config.iterations, render_frame));
+
+    spr_diagnostic_sink = nullptr;
+    print_results(config, results);
+    return 0;
+}
@@ -0,0 +1,178 @@
+// Headless batch validator: parses (and by default decodes) every .spr/.ani under the asset root
+// in parallel and prints one JSON object per file, followed by a summary line.
+//
+//   spr_check [--root DIR] [--jobs N] [--parse-only] [--strict]
+//
+// Exit status is 1 if any file has errors (or warnings, with --strict), otherwise 0.
+#include <gtkmm.h>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "asset_config.h"
+#include "image_item.h"
+#include "spr_parser.h"
+
+struct FileReport {
+    fs::path path;
+    bool parsed = false;
+    size_t frame_count = 0;
+    size_t frames_decoded = 0;
+    double parse_ms = 0;
+    double decode_ms = 0;
+    std::vector<SprDiagnostic> diagnostics;
+
+    bool has(SprSeverity severity) const {
+        for (const auto& d : diagnostics) {
+            if (d.severity == severity) return true;
+        }
+        return false;
+    }
+};
+
+std::string json_escape(const std::string& s) {
+    std::ostringstream out;
+    for (unsigned char c : s) {
+        switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\r': out << "\\r"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (c < 0x20)
+                    out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+                else
+                    out << c;
+        }
+    }
+    return out.str();
+}
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+FileReport check_file(const fs::path& path, const fs::path& asset_root_dir, bool decode) {
+    FileReport report;
+    report.path = path;
+    spr_diagnostic_sink = &report.diagnostics;
+
+    ImageItem item;
+    std::vector<ParsedFrameInfo> parsed_frames_info;
+    auto start = std::chrono::steady_clock::now();
+    report.parsed = parse_spr_file(path.string(), asset_root_dir, item, parsed_frames_info);
+    report.parse_ms = ms_since(start);
+    report.frame_count = parsed_frames_info.size();
+
+    if (report.parsed && decode) {
+        start = std::chrono::steady_clock::now();
+        for (const auto& p_frame_info : parsed_frames_info) {
+            try {
+                if (decode_frame(p_frame_info))
+                    report.frames_decoded++;
+            } catch (const Glib::Error& ex) {
+                if (item.is_animation)
+                    spr_log(SprSeverity::Error, "missing_frame") << "Cannot load animation frame '" << p_frame_info.image_path << "': " << ex.what();
+                else
+                    spr_log(SprSeverity::Error, "missing_image") << "Cannot load static image file '" << p_frame_info.image_path << "': " << ex.what();
+            }
+        }
+        report.decode_ms = ms_since(start);
+    }
+
+    spr_diagnostic_sink = nullptr;
+    return report;
+}
+
+void print_report(const FileReport& report) {
+    const char* status = !report.parsed || report.has(SprSeverity::Error) ? "error"
+                       : report.has(SprSeverity::Warning) ? "warning" : "ok";
+    std::cout << "{\"file\":\"" << json_escape(report.path.string()) << "\",\"status\":\"" << status << "\""
+              << ",\"frames\":" << report.frame_count << ",\"frames_decoded\":" << report.frames_decoded
+              << std::fixed << std::setprecision(3)
+              << ",\"parse_ms\":" << report.parse_ms << ",\"decode_ms\":" << report.decode_ms
+              << ",\"diagnostics\":[";
+    for (size_t i = 0; i < report.diagnostics.size(); ++i) {
+        const auto& d = report.diagnostics[i];
+        std::cout << (i ? "," : "") << "{\"severity\":\"" << spr_severity_name(d.severity) << "\",\"code\":\""
+                  << json_escape(d.code) << "\",\"message\":\"" << json_escape(d.message) << "\"}";
+    }
+    std::cout << "]}" << std::defaultfloat << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    fs::path asset_root_dir;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    bool decode = true;
+    bool strict = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--root" && i + 1 < argc) {
+            asset_root_dir = argv[++i];
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            jobs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--parse-only") {
+            decode = false;
+        } else if (arg == "--strict") {
+            strict = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--root DIR] [--jobs N] [--parse-only] [--strict]" << std::endl;
+            return 2;
+        }
+    }
+    if (asset_root_dir.empty())
+        asset_root_dir = read_asset_root_dir();
+
+    // Sets up the C++ wrappers for Gdk::Pixbuf without opening a display
+    Gtk::Main::init_gtkmm_internals();
+    // Frames are dropped after each file; don't let the shared cache hold the whole tree
+    ImageCache::instance().set_memory_cap(64u << 20);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<fs::path> files;
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(asset_root_dir, fs::directory_options::skip_permission_denied, ec);
+         it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) break;
+        if (!it->is_regular_file(ec)) continue;
+        auto ext = it->path().extension();
+        if (ext == ".spr" || ext == ".ani")
+            files.push_back(it->path());
+    }
+    if (ec)
+        std::cerr << "Warning: stopped scanning " << asset_root_dir << ": " << ec.message() << std::endl;
+    double scan_ms = ms_since(start);
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> ok_count{0}, warning_count{0}, error_count{0};
+    std::mutex output_mutex;
+    auto worker = [&] {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            FileReport report = check_file(files[i], asset_root_dir, decode);
+            if (!report.parsed || report.has(SprSeverity::Error)) error_count++;
+            else if (report.has(SprSeverity::Warning)) warning_count++;
+            else ok_count++;
+            std::lock_guard<std::mutex> lock(output_mutex);
+            print_report(report);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < std::min<size_t>(jobs, std::max<size_t>(1, files.size())); ++i)
+        workers.emplace_back(worker);
+    for (auto& t : workers)
+        t.join();
+
+    std::cout << "{\"summary\":{\"root\":\"" << json_escape(asset_root_dir.string()) << "\",\"files\":" << files.size()
+              << ",\"ok\":" << ok_count << ",\"warnings\":" << warning_count << ",\"errors\":" << error_count
+              << ",\"jobs\":" << workers.size() << std::fixed << std::setprecision(3)
+              << ",\"scan_ms\":" << scan_ms << ",\"total_ms\":" << ms_since(start) << "}}" << std::endl;
+
+    if (error_count > 0 || (strict && warning_count > 0))
+        return 1;
+    return 0;
+}
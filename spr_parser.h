@@ -1,110 +1,182 @@
+#pragma once
 #include <filesystem> // C++17, but widely used with C++20
+#include <charconv>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <vector>
 #include "image_item.h"
+#include "image_cache.h"
+#include "frame_pool.h"
+#include "perf_trace.h"
+#include "mapped_file.h"
 
 namespace fs = std::filesystem;
 
-struct ParsedFrameInfo {
-    fs::path image_path;
-    bool has_alpha_mask_in_frame_line = false; // For .ani files, if 'true' is present
+// --- Diagnostics ---
+// Everything the parser reports goes through spr_log. By default lines are printed as before
+// (info to stdout, warnings and errors to stderr). A tool can install a per-thread sink to
+// collect warnings and errors as records instead, e.g. for machine-readable output.
+enum class SprSeverity { Info, Warning, Error };
 
-    // Cropping parameters (if found for this frame or overall)
-    double mins = 0.0; // Default to full image (0%)
-    double mint = 0.0;
-    double maxs = 1.0; // Default to full image (100%)
-    double maxt = 1.0;
-
-    bool has_cropping = false; // True if mins/mint/maxs/maxt were explicitly defined
+struct SprDiagnostic {
+    SprSeverity severity;
+    std::string code;     // Stable identifier, e.g. "frame_count_mismatch"
+    std::string message;
 };
 
-// --- Helper Functions ---
-// Checks for .ani extension
-bool ends_with(const std::string& str, const std::string& suffix) {
-    if (str.length() < suffix.length()) {
-        return false;
+inline thread_local std::vector<SprDiagnostic>* spr_diagnostic_sink = nullptr;
+
+inline const char* spr_severity_name(SprSeverity severity) {
+    switch (severity) {
+        case SprSeverity::Info: return "info";
+        case SprSeverity::Warning: return "warning";
+        default: return "error";
     }
-    return str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
 }
 
+class SprLogLine {
+public:
+    SprLogLine(SprSeverity severity, const char* code) : m_severity(severity), m_code(code) {}
 
+    ~SprLogLine() {
+        if (spr_diagnostic_sink) {
+            if (m_severity != SprSeverity::Info)
+                spr_diagnostic_sink->push_back({m_severity, m_code ? m_code : "", m_text.str()});
+        } else if (m_severity == SprSeverity::Info) {
+            std::cout << m_text.str() << std::endl;
+        } else {
+            std::cerr << (m_severity == SprSeverity::Warning ? "Warning: " : "Error: ") << m_text.str() << std::endl;
+        }
+    }
 
-// Checks if a string consists only of digits (and optional sign)
-bool is_integer(const std::string& s) {
-    if (s.empty()) return false;
-    size_t start = 0;
-    if (s[0] == '-' || s[0] == '+') {
-        start = 1;
-        if (s.length() == 1) return false; // Just a sign, not a number
+    template <typename T>
+    SprLogLine& operator<<(const T& value) {
+        m_text << value;
+        return *this;
     }
-    for (size_t i = start; i < s.length(); ++i) {
-        if (!std::isdigit(s[i])) {
-            return false;
-        }
+
+private:
+    SprSeverity m_severity;
+    const char* m_code;
+    std::ostringstream m_text;
+};
+
+inline SprLogLine spr_log(SprSeverity severity, const char* code) {
+    return SprLogLine(severity, code);
+}
+
+// --- Helper Functions ---
+// All tokenizing works on std::string_view slices of the file buffer, so parsing a file does no
+// heap allocation besides the output paths and the ParsedFrameInfo vector itself.
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+inline std::string_view trim(std::string_view s) {
+    while (!s.empty() && is_space(s.front())) s.remove_prefix(1);
+    while (!s.empty() && is_space(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+// Splits off the next whitespace-separated token; `rest` is left just after it, like `iss >> token`
+inline std::string_view next_token(std::string_view& rest) {
+    size_t start = 0;
+    while (start < rest.size() && is_space(rest[start])) ++start;
+    size_t end = start;
+    while (end < rest.size() && !is_space(rest[end])) ++end;
+    std::string_view token = rest.substr(start, end - start);
+    rest.remove_prefix(end);
+    return token;
+}
+
+// Splits off the next '\n'-terminated line (without the '\n'); false once the buffer is exhausted
+inline bool next_line(std::string_view& buffer, std::string_view& line) {
+    if (buffer.empty())
+        return false;
+    size_t eol = buffer.find('\n');
+    if (eol == std::string_view::npos) {
+        line = buffer;
+        buffer = {};
+    } else {
+        line = buffer.substr(0, eol);
+        buffer.remove_prefix(eol + 1);
     }
     return true;
 }
 
-// Checks if a string can be interpreted as a double
-bool is_double(const std::string& s) {
+// Checks for .ani extension
+inline bool ends_with(std::string_view str, std::string_view suffix) {
+    return str.size() >= suffix.size() && str.substr(str.size() - suffix.size()) == suffix;
+}
+
+// Parses a string consisting only of digits (and optional sign)
+inline bool parse_integer(std::string_view s, int& value) {
+    if (!s.empty() && s[0] == '+') s.remove_prefix(1);
     if (s.empty()) return false;
-    std::istringstream iss(s);
-    double d;
-    iss >> d;
-    return iss.eof() && !iss.fail();
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    return ec == std::errc() && ptr == s.data() + s.size();
 }
 
-// Function to parse min/max cropping parameters from a string
-// Returns true if all 4 parameters were successfully found and parsed.
-bool parse_cropping_params(const std::string& line_part, double& mins, double& mint, double& maxs, double& maxt) {
-    std::map<std::string, double*> param_map;
-    param_map["mins"] = &mins;
-    param_map["mint"] = &mint;
-    param_map["maxs"] = &maxs;
-    param_map["maxt"] = &maxt;
+inline bool is_integer(std::string_view s) {
+    int value;
+    return parse_integer(s, value);
+}
+
+// Parses a string that is entirely a decimal floating point number
+inline bool parse_double(std::string_view s, double& value) {
+    if (!s.empty() && s[0] == '+') s.remove_prefix(1);
+    if (s.empty()) return false;
+    char first = s[0] == '-' && s.size() > 1 ? s[1] : s[0];
+    if (!std::isdigit(static_cast<unsigned char>(first)) && first != '.') return false; // no inf/nan
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    return ec == std::errc() && ptr == s.data() + s.size();
+}
 
-    int found_count = 0; // Track how many parameters we successfully parse
+inline bool is_double(std::string_view s) {
+    double value;
+    return parse_double(s, value);
+}
+
+// Function to parse min/max cropping parameters from a "key=value, key=value" list
+// Returns true if all 4 parameters were successfully found and parsed.
+inline bool parse_cropping_params(std::string_view line_part, double& mins, double& mint, double& maxs, double& maxt) {
+    unsigned found_mask = 0; // One bit per parameter successfully parsed
 
-    std::stringstream ss(line_part);
-    std::string segment;
+    while (!line_part.empty()) {
+        size_t comma = line_part.find(',');
+        std::string_view segment = line_part.substr(0, comma);
+        line_part = comma == std::string_view::npos ? std::string_view{} : line_part.substr(comma + 1);
 
-    while (std::getline(ss, segment, ',')) {
         size_t eq_pos = segment.find('=');
-        if (eq_pos != std::string::npos) {
-            std::string key_str = segment.substr(0, eq_pos);
-            std::string val_str = segment.substr(eq_pos + 1);
-
-            // Trim whitespace from key and value
-            key_str.erase(0, key_str.find_first_not_of(" \t\n\r\f\v"));
-            key_str.erase(key_str.find_last_not_of(" \t\n\r\f\v") + 1);
-            val_str.erase(0, val_str.find_first_not_of(" \t\n\r\f\v"));
-            val_str.erase(val_str.find_last_not_of(" \t\n\r\f\v") + 1);
-
-            if (param_map.count(key_str) && is_double(val_str)) {
-                *param_map[key_str] = std::stod(val_str);
-                found_count++;
-            }
+        if (eq_pos == std::string_view::npos)
+            continue;
+        std::string_view key = trim(segment.substr(0, eq_pos));
+        std::string_view val = trim(segment.substr(eq_pos + 1));
+
+        int param = key == "mins" ? 0 : key == "mint" ? 1 : key == "maxs" ? 2 : key == "maxt" ? 3 : -1;
+        double* targets[] = {&mins, &mint, &maxs, &maxt};
+        double value;
+        if (param >= 0 && parse_double(val, value)) {
+            *targets[param] = value;
+            found_mask |= 1u << param;
         }
     }
-    return found_count == 4; // All 4 parameters must be found
+    return found_mask == 0xf; // All 4 parameters must be found
 }
 
 
-// --- Main load_spr_file function ---
-std::shared_ptr<ImageItem> load_spr_file(const std::string& filename, const fs::path& asset_root_dir) {
-    auto item = std::make_shared<ImageItem>();
-    fs::path spr_filepath(filename);
-
-    std::ifstream file(filename);
-    if (!file) {
-        std::cerr << "Error: Cannot open SPR file: " << filename << std::endl;
-        return nullptr;
-    }
-
-    std::string line;
+// --- Parse step: reads the SPR/ANI text into item fields and per-frame info, decodes nothing ---
+// `contents` is the whole file; `filename` is only used in messages. Returns false if the file
+// cannot be used at all.
+inline bool parse_spr_buffer(std::string_view contents, const std::string& filename, const fs::path& asset_root_dir,
+                             ImageItem& item, std::vector<ParsedFrameInfo>& parsed_frames_info) {
+    std::string_view line;
     bool initial_is_animation_determination = false;
 
     // Helper lambda for resolving paths relative to the asset root
-    auto resolve_path = [&](const std::string& relative_path_str) -> fs::path {
+    auto resolve_path = [&](std::string_view relative_path_str) -> fs::path {
         fs::path p(relative_path_str);
         if (p.is_absolute()) {
             return p; // If it's already absolute, use it directly
@@ -112,41 +184,34 @@ std::shared_ptr<ImageItem> load_spr_file(const std::string& filename, const fs::
         // If it's relative, combine with the asset_root_dir
         return asset_root_dir / p;
     };
-    getline(file, line);
-    std::istringstream iss_line1(line);
-    std::string token1, token2;
-    iss_line1 >> token1 >> token2;
+    next_line(contents, line);
+    std::string_view token1 = next_token(line);
+    std::string_view token2 = next_token(line);
     if (ends_with(token1, ".ani")) {
-        item->is_animation = true;
+        item.is_animation = true;
         initial_is_animation_determination = true;
-        std::cout << "File extension is .ani: Assuming animation." << std::endl;
+        spr_log(SprSeverity::Info, nullptr) << "File extension is .ani: Assuming animation.";
     } else {
         if (is_double(token1) && is_double(token2)) {
-            item->is_animation = true;
-            initial_is_animation_determination = true;
-            std::cout << "Line 1 has two doubles: Assuming animation." << std::endl;
-        } 
-        if (ends_with(token1,".ani")){
-        
+            spr_log(SprSeverity::Info, nullptr) << "Line 1 has two doubles: Assuming animation.";
         }
-        else {
-            item->is_animation = false;
-            initial_is_animation_determination = false;
-            item->static_image_filepath = resolve_path(token1);
-            if (token2 == "0") {
-                item->has_static_alpha_mask = false;
-            } else {
-                item->has_static_alpha_mask = true;
-                item->alpha_mask_filepath = resolve_path(token2);
-            }
+        // As in the original parser, two-double lines still fall through to the static layout
+        // (Line 2 skipped); a non-zero frame count on Line 3 is what turns them into animations.
+        item.is_animation = false;
+        initial_is_animation_determination = false;
+        item.static_image_filepath = resolve_path(token1);
+        if (token2 == "0") {
+            item.has_static_alpha_mask = false;
+        } else {
+            item.has_static_alpha_mask = true;
+            item.alpha_mask_filepath = resolve_path(token2);
         }
     }
     // --- Line 2: Always two doubles, ignore content ---
     if (!initial_is_animation_determination) {
-        if (std::getline(file, line)) { /* ignore */ }
-        else {
-            std::cerr << "Warning: SPR file " << filename << " ended prematurely before Line 2 (ignored doubles)." << std::endl;
-            return nullptr;
+        if (!next_line(contents, line)) {
+            spr_log(SprSeverity::Error, "premature_end") << "SPR file " << filename << " ended prematurely before Line 2 (ignored doubles).";
+            return false;
         }
     }
 
@@ -154,86 +219,70 @@ std::shared_ptr<ImageItem> load_spr_file(const std::string& filename, const fs::
     int declared_num_frames = 0;
     double overall_mins = 0.0, overall_mint = 0.0, overall_maxs = 1.0, overall_maxt = 1.0;
     bool has_overall_cropping = false;
-    if (std::getline(file, line)) {
-        std::istringstream iss_line3(line);
-        std::string token_num_frames_str, token_time_ms_str;
-        iss_line3 >> token_num_frames_str >> token_time_ms_str;
-        std::cout << " Frames: "<< token_num_frames_str << " Time: " << token_time_ms_str << std::endl;
-
-        if (is_integer(token_num_frames_str) && is_integer(token_time_ms_str)) {
-            declared_num_frames = std::stoi(token_num_frames_str);
-            item->frame_delay_ms = std::stod(token_time_ms_str);
-            std::cout << "Line 3: Declared Frames=" << declared_num_frames << ", Frame Delay=" << item->frame_delay_ms << std::endl;
-
-            std::string remaining_line;
-            if (std::getline(iss_line3, remaining_line)) {
-                 if (parse_cropping_params(remaining_line, overall_mins, overall_mint, overall_maxs, overall_maxt)) {
-                     has_overall_cropping = true;
-                     std::cout << "Line 3: Found overall cropping parameters." << std::endl;
-                 }
+    if (next_line(contents, line)) {
+        std::string_view rest = line;
+        std::string_view token_num_frames_str = next_token(rest);
+        std::string_view token_time_ms_str = next_token(rest);
+        spr_log(SprSeverity::Info, nullptr) << " Frames: "<< token_num_frames_str << " Time: " << token_time_ms_str;
+
+        int frame_delay = 0;
+        if (parse_integer(token_num_frames_str, declared_num_frames) && parse_integer(token_time_ms_str, frame_delay)) {
+            item.frame_delay_ms = frame_delay;
+            spr_log(SprSeverity::Info, nullptr) << "Line 3: Declared Frames=" << declared_num_frames << ", Frame Delay=" << item.frame_delay_ms;
+
+            if (parse_cropping_params(rest, overall_mins, overall_mint, overall_maxs, overall_maxt)) {
+                has_overall_cropping = true;
+                spr_log(SprSeverity::Info, nullptr) << "Line 3: Found overall cropping parameters.";
             }
 
-            if (!item->is_animation && declared_num_frames == 0) {
-                 std::cout << "Line 3: 0 0, confirming static sprite with Line 1 image." << std::endl;
+            if (!item.is_animation && declared_num_frames == 0) {
+                 spr_log(SprSeverity::Info, nullptr) << "Line 3: 0 0, confirming static sprite with Line 1 image.";
             } else {
-                item->is_animation = true;
+                item.is_animation = true;
             }
         } else {
-            std::cerr << "Warning: SPR file " << filename << " Line 3 not in expected 'int int' format. " << line << "  This might indicate an issue." << std::endl;
-            if (!item->is_animation) {
-                std::cerr << "Error: SPR file " << filename << " is static but has malformed Line 3. Aborting." << std::endl;
-                return nullptr;
+            spr_log(SprSeverity::Warning, "malformed_frame_line") << "SPR file " << filename << " Line 3 not in expected 'int int' format. " << line << "  This might indicate an issue.";
+            if (!item.is_animation) {
+                spr_log(SprSeverity::Error, "malformed_frame_line") << "SPR file " << filename << " is static but has malformed Line 3. Aborting.";
+                return false;
             }
             declared_num_frames = 0;
-            item->frame_delay_ms = 100;
+            item.frame_delay_ms = 100;
         }
     } else {
-        std::cerr << "Error: SPR file " << filename << " missing Line 3 (frame count/time)." << std::endl;
-        return nullptr;
+        spr_log(SprSeverity::Error, "missing_frame_line") << "SPR file " << filename << " missing Line 3 (frame count/time).";
+        return false;
     }
 
-    // --- Load Gdk::Pixbuf(s) ---
-    std::vector<ParsedFrameInfo> parsed_frames_info;
+    // --- Frame list ---
+    parsed_frames_info.clear();
 
-    if (!item->is_animation) {
-        try {
-            auto static_pixbuf = Gdk::Pixbuf::create_from_file(item->static_image_filepath.string());
-            item->frames.push_back(static_pixbuf);
-        } catch (const Glib::Error& ex) {
-            std::cerr << "Error loading static image file '" << item->static_image_filepath << "': " << ex.what() << std::endl;
-            return nullptr;
-        }
+    if (!item.is_animation) {
+        ParsedFrameInfo static_frame_info;
+        static_frame_info.image_path = item.static_image_filepath;
+        if (item.has_static_alpha_mask)
+            static_frame_info.alpha_mask_path = item.alpha_mask_filepath;
+        parsed_frames_info.push_back(static_frame_info);
     } else {
-        std::cout << "Reading animation frame paths..." << std::endl;
-        while (std::getline(file, line)) {
-            std::istringstream iss_frame(line);
-            std::string image_path_str;
-            iss_frame >> image_path_str;
+        spr_log(SprSeverity::Info, nullptr) << "Reading animation frame paths...";
+        if (declared_num_frames > 0) // never trust the header beyond what the rest of the file could hold
+            parsed_frames_info.reserve(std::min<size_t>(declared_num_frames, contents.size() / 2 + 1));
+        while (next_line(contents, line)) {
+            std::string_view rest = line;
+            std::string_view image_path_str = next_token(rest);
             if (image_path_str.empty()) continue;
 
-            ParsedFrameInfo current_frame_info;
-            current_frame_info.image_path = resolve_path(image_path_str); // Use the new helper
-
-            std::string remaining_frame_line;
-            if (std::getline(iss_frame, remaining_frame_line)) {
-                std::istringstream iss_remaining(remaining_frame_line);
-                std::string true_keyword_check;
-                iss_remaining >> true_keyword_check;
-                true_keyword_check.erase(0, true_keyword_check.find_first_not_of(" \t\n\r\f\v")); true_keyword_check.erase(true_keyword_check.find_last_not_of(" \t\n\r\f\v") + 1);
-
-                if (true_keyword_check == "true") {
-                    current_frame_info.has_alpha_mask_in_frame_line = true;
-                    if (std::getline(iss_remaining, remaining_frame_line)) {
-                        if (parse_cropping_params(remaining_frame_line, current_frame_info.mins, current_frame_info.mint, current_frame_info.maxs, current_frame_info.maxt)) {
-                            current_frame_info.has_cropping = true;
-                        }
-                    }
-                } else {
-                    remaining_frame_line = true_keyword_check + remaining_frame_line;
-                    if (parse_cropping_params(remaining_frame_line, current_frame_info.mins, current_frame_info.mint, current_frame_info.maxs, current_frame_info.maxt)) {
-                        current_frame_info.has_cropping = true;
-                    }
-                }
+            ParsedFrameInfo& current_frame_info = parsed_frames_info.emplace_back();
+            current_frame_info.image_path = resolve_path(image_path_str);
+
+            // Optional 'true' (frame has an alpha mask), then optional cropping parameters
+            std::string_view after_keyword = rest;
+            if (next_token(after_keyword) == "true") {
+                current_frame_info.has_alpha_mask_in_frame_line = true;
+                rest = after_keyword;
+            }
+            if (parse_cropping_params(rest, current_frame_info.mins, current_frame_info.mint, current_frame_info.maxs, current_frame_info.maxt)) {
+                current_frame_info.has_cropping = true;
             }
 
             if (!current_frame_info.has_cropping && has_overall_cropping) {
@@ -243,43 +292,106 @@ std::shared_ptr<ImageItem> load_spr_file(const std::string& filename, const fs::
                 current_frame_info.maxt = overall_maxt;
                 current_frame_info.has_cropping = true;
             }
-
-            parsed_frames_info.push_back(current_frame_info);
         }
 
         if (declared_num_frames > 0 && parsed_frames_info.size() != static_cast<size_t>(declared_num_frames)) {
-            std::cerr << "Warning: Mismatch between declared number of frames (" << declared_num_frames
-                      << ") and actual frames read (" << parsed_frames_info.size() << ") in " << filename << std::endl;
+            spr_log(SprSeverity::Warning, "frame_count_mismatch") << "Mismatch between declared number of frames (" << declared_num_frames
+                      << ") and actual frames read (" << parsed_frames_info.size() << ") in " << filename;
         }
+    }
 
-        for (const auto& p_frame_info : parsed_frames_info) {
-            try {
-                auto pixbuf = Gdk::Pixbuf::create_from_file(p_frame_info.image_path.string());
-
-                if (p_frame_info.has_cropping && pixbuf) {
-                    int src_x = static_cast<int>(pixbuf->get_width() * p_frame_info.mins);
-                    int src_y = static_cast<int>(pixbuf->get_height() * p_frame_info.mint);
-                    int width = static_cast<int>(pixbuf->get_width() * (p_frame_info.maxs - p_frame_info.mins));
-                    int height = static_cast<int>(pixbuf->get_height() * (p_frame_info.maxt - p_frame_info.mint));
-
-                    if (width > 0 && height > 0) {
-                        pixbuf = pixbuf->create_subpixbuf(pixbuf, src_x, src_y, width, height);
-                    } else {
-                        std::cerr << "Warning: Invalid cropping dimensions for frame " << p_frame_info.image_path << ". Not cropping." << std::endl;
-                    }
-                }
-                item->frames.push_back(pixbuf);
-            } catch (const Glib::Error& ex) {
-                std::cerr << "Error loading animation frame '" << p_frame_info.image_path << "': " << ex.what() << std::endl;
-                item->frames.push_back({});
-            }
+    if (!item.is_animation && parsed_frames_info.size() > 1) {
+        spr_log(SprSeverity::Warning, "static_with_frames") << "SPR file " << filename << " identified as static, but multiple frames were loaded. Forcing to animation.";
+        item.is_animation = true;
+    }
+
+    item.frame_infos = parsed_frames_info;
+    item.source_path = filename;
+    return true;
+}
+
+// Maps the file and parses it in place
+inline bool parse_spr_file(const std::string& filename, const fs::path& asset_root_dir,
+                           ImageItem& item, std::vector<ParsedFrameInfo>& parsed_frames_info) {
+    perf::Scope timer("parse_spr_file", "load");
+    MappedFile file(filename);
+    if (!file.is_open()) {
+        spr_log(SprSeverity::Error, "open_failed") << "Cannot open SPR file: " << filename;
+        return false;
+    }
+    return parse_spr_buffer(file.view(), filename, asset_root_dir, item, parsed_frames_info);
+}
+
+// --- Decode step: loads one frame image and applies its cropping ---
+// Throws Glib::Error if the image cannot be decoded. Safe to call from worker threads.
+// The source image comes from the shared ImageCache, so crops of one atlas decode it only once.
+// A separate alpha mask is merged in after cropping; if it can't be loaded the frame stays unmasked.
+inline Glib::RefPtr<Gdk::Pixbuf> decode_frame(const ParsedFrameInfo& p_frame_info) {
+    perf::Scope timer("decode_frame", "load");
+    auto pixbuf = ImageCache::instance().get(p_frame_info.image_path);
+
+    Glib::RefPtr<Gdk::Pixbuf> mask;
+    if (!p_frame_info.alpha_mask_path.empty() && pixbuf) {
+        try {
+            mask = ImageCache::instance().get(p_frame_info.alpha_mask_path);
+        } catch (const Glib::Error& ex) {
+            spr_log(SprSeverity::Warning, "missing_alpha_mask") << "Cannot load alpha mask '" << p_frame_info.alpha_mask_path << "': " << ex.what() << ". Drawing without it.";
         }
+        if (mask && (mask->get_width() != pixbuf->get_width() || mask->get_height() != pixbuf->get_height()))
+            mask = mask->scale_simple(pixbuf->get_width(), pixbuf->get_height(), Gdk::INTERP_BILINEAR);
     }
 
-    if (!item->is_animation && !item->frames.empty() && item->frames.size() > 1) {
-        std::cerr << "Warning: SPR file " << filename << " identified as static, but multiple frames were loaded. Forcing to animation." << std::endl;
-        item->is_animation = true;
+    if (p_frame_info.has_cropping && pixbuf) {
+        int src_x = static_cast<int>(pixbuf->get_width() * p_frame_info.mins);
+        int src_y = static_cast<int>(pixbuf->get_height() * p_frame_info.mint);
+        int width = static_cast<int>(pixbuf->get_width() * (p_frame_info.maxs - p_frame_info.mins));
+        int height = static_cast<int>(pixbuf->get_height() * (p_frame_info.maxt - p_frame_info.mint));
+
+        if (width > 0 && height > 0) {
+            pixbuf = pixbuf->create_subpixbuf(pixbuf, src_x, src_y, width, height);
+            if (mask)
+                mask = mask->create_subpixbuf(mask, src_x, src_y, width, height);
+        } else {
+            spr_log(SprSeverity::Warning, "invalid_crop") << "Invalid cropping dimensions for frame " << p_frame_info.image_path << ". Not cropping.";
+        }
     }
+    if (mask)
+        pixbuf = composite_alpha_mask(pixbuf, mask);
+    // Loop repeats, hold frames and identical images under other names become one shared frame.
+    // Only a masked frame has pixels of its own; the others are (views of) an ImageCache entry.
+    pixbuf = FramePool::instance().intern(pixbuf, static_cast<bool>(mask));
+    // Built here, off the main thread for async loads, so drawing and clicks never pay for them
+    premultiplied_surface_for(pixbuf);
+    ImageCache::instance().charge_attached_surface(pixbuf);
+    opacity_mask_for(pixbuf);
+    return pixbuf;
+}
+
+// --- Main load_spr_file function: parse, then decode every frame on the calling thread ---
+inline std::shared_ptr<ImageItem> load_spr_file(const std::string& filename, const fs::path& asset_root_dir) {
+    perf::Scope timer("load_spr_file", "load");
+    auto item = std::make_shared<ImageItem>();
+    std::vector<ParsedFrameInfo> parsed_frames_info;
+    if (!parse_spr_file(filename, asset_root_dir, *item, parsed_frames_info))
+        return nullptr;
 
+    if (!item->is_animation) {
+        try {
+            item->frames.push_back(decode_frame(parsed_frames_info.front()));
+        } catch (const Glib::Error& ex) {
+            spr_log(SprSeverity::Error, "missing_image") << "Cannot load static image file '" << item->static_image_filepath << "': " << ex.what();
+            return nullptr;
+        }
+        return item;
+    }
+
+    for (const auto& p_frame_info : parsed_frames_info) {
+        try {
+            item->frames.push_back(decode_frame(p_frame_info));
+        } catch (const Glib::Error& ex) {
+            spr_log(SprSeverity::Error, "missing_frame") << "Cannot load animation frame '" << p_frame_info.image_path << "': " << ex.what();
+            item->frames.push_back({});
+        }
+    }
     return item;
 }
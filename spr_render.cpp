@@ -0,0 +1,355 @@
+// Headless scene renderer: draws a sprite, layout (.py/.cpt) or image at successive frame times
+// into PNGs, or compares those frames against a directory of golden PNGs, without a display.
+// Frames are rendered in parallel, one frame per task, through the canvas's own draw_items.
+//
+//   spr_render SCENE [--root DIR] [--out DIR] [--compare DIR] [--frames N] [--step MS]
+//                    [--size WxH] [--zoom Z] [--background RRGGBBAA] [--tolerance N] [--jobs N]
+//
+// Frame i shows the scene i * step ms after every animation started and is named frame_NNNN.png.
+// With --compare, each frame is checked against the file of the same name in DIR: a pixel differs
+// when any premultiplied channel is more than --tolerance (default 0) away from the golden one.
+// One JSON object is printed per frame, then a summary line; exit status is 1 if any frame
+// differs, is missing or can't be written. Parser warnings and errors go to stderr and are
+// counted in the summary, so stdout stays one JSON object per line.
+#include <gtkmm.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "asset_config.h"
+#include "image_item.h"
+#include "layout_io.h"
+#include "scene_renderer.h"
+#include "spr_parser.h"
+
+struct RenderConfig {
+    fs::path scene;
+    fs::path asset_root_dir;
+    fs::path out_dir;
+    fs::path compare_dir;
+    size_t frames = 0;      // 0: longest animation's frame count
+    double step_ms = 0;     // 0: shortest animated frame delay
+    bool size_given = false;
+    RenderOptions options;
+    int tolerance = 0;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+};
+
+struct FrameReport {
+    size_t index = 0;
+    double time_ms = 0;
+    double render_ms = 0;
+    std::string status = "ok"; // ok, written, match, differs, missing, error
+    std::string error;
+    int max_diff = 0;
+    size_t differing_pixels = 0;
+};
+
+std::string json_escape(const std::string& s) {
+    std::ostringstream out;
+    for (unsigned char c : s) {
+        switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\r': out << "\\r"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (c < 0x20)
+                    out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+                else
+                    out << c;
+        }
+    }
+    return out.str();
+}
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string frame_name(size_t index) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "frame_%04zu.png", index);
+    return name;
+}
+
+// Loads a sprite fully decoded, or a plain image, as the editor would add it
+std::shared_ptr<ImageItem> load_item(const fs::path& path, const fs::path& asset_root_dir) {
+    if (path.extension() == ".spr" || path.extension() == ".ani") {
+        auto item = load_spr_file(path.string(), asset_root_dir);
+        if (!item || item->frames.empty()) {
+            std::cerr << "Error: could not load sprite " << path << std::endl;
+            return nullptr;
+        }
+        return item;
+    }
+    try {
+        auto item = std::make_shared<ImageItem>();
+        item->frames.push_back(ImageCache::instance().get(path));
+        item->source_path = path;
+        return item;
+    } catch (const Glib::Error& ex) {
+        std::cerr << "Error: could not load image " << path << ": " << ex.what() << std::endl;
+        return nullptr;
+    }
+}
+
+// Sends what the parser collected to stderr, in the form it would have used without a sink
+void report_diagnostics(const std::vector<SprDiagnostic>& diagnostics) {
+    for (const auto& d : diagnostics)
+        std::cerr << (d.severity == SprSeverity::Warning ? "Warning: " : "Error: ") << d.message << std::endl;
+}
+
+bool load_scene(const RenderConfig& config, std::vector<std::shared_ptr<ImageItem>>& items) {
+    if (config.scene.extension() != ".py" && config.scene.extension() != ".cpt") {
+        auto item = load_item(config.scene, config.asset_root_dir);
+        if (!item)
+            return false;
+        items.push_back(item);
+        return true;
+    }
+    std::vector<LayoutEntry> entries;
+    if (!read_layout(config.scene, config.asset_root_dir, LayoutCanvas{}, entries))
+        return false;
+    for (const auto& entry : entries) {
+        auto item = load_item(entry.source, config.asset_root_dir);
+        if (!item)
+            return false; // a regression run must not silently drop part of the scene
+        item->x = entry.x;
+        item->y = entry.y;
+        item->scale_x = entry.scale_x;
+        item->scale_y = entry.scale_y;
+        items.push_back(item);
+    }
+    return true;
+}
+
+// Compares premultiplied ARGB32 pixels; sizes must already match
+void compare_surfaces(const Cairo::RefPtr<Cairo::ImageSurface>& rendered, const Cairo::RefPtr<Cairo::ImageSurface>& golden,
+                      int tolerance, FrameReport& report) {
+    int w = rendered->get_width(), h = rendered->get_height();
+    const unsigned char* a = rendered->get_data();
+    const unsigned char* b = golden->get_data();
+    for (int y = 0; y < h; ++y) {
+        const unsigned char* row_a = a + static_cast<size_t>(y) * rendered->get_stride();
+        const unsigned char* row_b = b + static_cast<size_t>(y) * golden->get_stride();
+        for (int x = 0; x < 4 * w; x += 4) {
+            int diff = 0;
+            for (int c = 0; c < 4; ++c)
+                diff = std::max(diff, std::abs(int(row_a[x + c]) - int(row_b[x + c])));
+            report.max_diff = std::max(report.max_diff, diff);
+            if (diff > tolerance)
+                report.differing_pixels++;
+        }
+    }
+}
+
+FrameReport render_frame(const RenderConfig& config, const std::vector<std::shared_ptr<ImageItem>>& items, size_t index) {
+    FrameReport report;
+    report.index = index;
+    report.time_ms = index * config.step_ms;
+    auto start = std::chrono::steady_clock::now();
+    auto surface = render_scene(items, report.time_ms, config.options);
+    report.render_ms = ms_since(start);
+
+    if (!config.compare_dir.empty()) {
+        fs::path golden_path = config.compare_dir / frame_name(index);
+        std::error_code ec;
+        if (!fs::exists(golden_path, ec)) {
+            report.status = "missing";
+            return report;
+        }
+        Cairo::RefPtr<Cairo::ImageSurface> golden;
+        try {
+            golden = Cairo::ImageSurface::create_from_png(golden_path.string());
+        } catch (const std::exception& ex) {
+            report.status = "error";
+            report.error = ex.what();
+            return report;
+        }
+        if (golden->get_width() != surface->get_width() || golden->get_height() != surface->get_height()) {
+            report.status = "differs";
+            report.error = "size " + std::to_string(golden->get_width()) + "x" + std::to_string(golden->get_height());
+            return report;
+        }
+        golden->flush();
+        compare_surfaces(surface, golden, config.tolerance, report);
+        report.status = report.differing_pixels ? "differs" : "match";
+    }
+
+    if (!config.out_dir.empty()) {
+        // Written beside the target and renamed, so an interrupted run never leaves a truncated golden
+        fs::path target = config.out_dir / frame_name(index);
+        fs::path temp = target.string() + ".tmp";
+        std::error_code ec;
+        try {
+            surface->write_to_png(temp.string());
+            fs::rename(temp, target, ec);
+        } catch (const std::exception& ex) {
+            ec = std::make_error_code(std::errc::io_error);
+            report.error = ex.what();
+        }
+        if (ec) {
+            fs::remove(temp, ec);
+            report.status = "error";
+            if (report.error.empty())
+                report.error = "cannot write " + target.string();
+        } else if (report.status == "ok") {
+            report.status = "written";
+        }
+    }
+    return report;
+}
+
+void print_report(const FrameReport& report) {
+    std::cout << "{\"frame\":" << report.index << ",\"file\":\"" << frame_name(report.index) << "\""
+              << std::fixed << std::setprecision(3) << ",\"time_ms\":" << report.time_ms
+              << ",\"render_ms\":" << report.render_ms << std::defaultfloat
+              << ",\"status\":\"" << report.status << "\"";
+    if (report.status == "match" || report.status == "differs")
+        std::cout << ",\"max_diff\":" << report.max_diff << ",\"differing_pixels\":" << report.differing_pixels;
+    if (!report.error.empty())
+        std::cout << ",\"error\":\"" << json_escape(report.error) << "\"";
+    std::cout << "}\n";
+}
+
+// Smallest size, centred on the canvas origin like the editor, that holds every frame of the scene
+void fit_size_to_scene(const std::vector<std::shared_ptr<ImageItem>>& items, RenderOptions& options) {
+    double half_w = 0, half_h = 0;
+    for (const auto& item : items) {
+        for (size_t i = 0; i < item->frame_count(); ++i) {
+            ItemBounds b = item->bounds(i);
+            if (b.empty()) continue;
+            half_w = std::max({half_w, std::abs(b.left), std::abs(b.left + b.width)});
+            half_h = std::max({half_h, std::abs(b.top), std::abs(b.top + b.height)});
+        }
+    }
+    if (half_w > 0 && half_h > 0) {
+        options.width = std::max(1, static_cast<int>(std::ceil(2 * half_w * options.zoom)));
+        options.height = std::max(1, static_cast<int>(std::ceil(2 * half_h * options.zoom)));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    RenderConfig config;
+    bool usage_error = false;
+    for (int i = 1; i < argc && !usage_error; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--root" && has_value) {
+            config.asset_root_dir = argv[++i];
+        } else if (arg == "--out" && has_value) {
+            config.out_dir = argv[++i];
+        } else if (arg == "--compare" && has_value) {
+            config.compare_dir = argv[++i];
+        } else if (arg == "--frames" && has_value) {
+            config.frames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--step" && has_value) {
+            config.step_ms = std::max(0.0, std::atof(argv[++i]));
+        } else if (arg == "--size" && has_value) {
+            usage_error = std::sscanf(argv[++i], "%dx%d", &config.options.width, &config.options.height) != 2 ||
+                          config.options.width <= 0 || config.options.height <= 0;
+            config.size_given = true;
+        } else if (arg == "--zoom" && has_value) {
+            config.options.zoom = std::atof(argv[++i]);
+            usage_error = !(config.options.zoom > 0);
+        } else if (arg == "--background" && has_value) {
+            config.options.background = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 16));
+        } else if (arg == "--tolerance" && has_value) {
+            config.tolerance = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--jobs" && has_value) {
+            config.jobs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg[0] != '-' && config.scene.empty()) {
+            config.scene = arg;
+        } else {
+            usage_error = true;
+        }
+    }
+    if (usage_error || config.scene.empty()) {
+        std::cerr << "Usage: " << argv[0] << " SCENE [--root DIR] [--out DIR] [--compare DIR] [--frames N] [--step MS]"
+                  << " [--size WxH] [--zoom Z] [--background RRGGBBAA] [--tolerance N] [--jobs N]" << std::endl;
+        return 2;
+    }
+    if (config.asset_root_dir.empty())
+        config.asset_root_dir = read_asset_root_dir();
+    if (!config.out_dir.empty()) {
+        std::error_code ec;
+        fs::create_directories(config.out_dir, ec);
+        if (ec) {
+            std::cerr << "Error: cannot create " << config.out_dir << ": " << ec.message() << std::endl;
+            return 1;
+        }
+    }
+
+    // Sets up the C++ wrappers for Gdk::Pixbuf without opening a display
+    Gtk::Main::init_gtkmm_internals();
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<ImageItem>> items;
+    std::vector<SprDiagnostic> diagnostics; // keeps the parser's progress lines off stdout
+    spr_diagnostic_sink = &diagnostics;
+    bool loaded = load_scene(config, items);
+    spr_diagnostic_sink = nullptr;
+    report_diagnostics(diagnostics);
+    if (!loaded)
+        return 1;
+    // Surfaces and mip levels are built here; each thread then draws its own copy of the scene
+    prepare_scene(items, config.options.zoom);
+    double load_ms = ms_since(start);
+
+    double shortest_delay = 0;
+    size_t longest = 1;
+    for (const auto& item : items) {
+        if (!item->is_animated()) continue;
+        longest = std::max(longest, item->frame_count());
+        if (shortest_delay == 0 || item->frame_delay_ms < shortest_delay)
+            shortest_delay = item->frame_delay_ms;
+    }
+    if (config.frames == 0)
+        config.frames = longest;
+    if (config.step_ms == 0)
+        config.step_ms = shortest_delay;
+    if (!config.size_given)
+        fit_size_to_scene(items, config.options);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<FrameReport> reports(config.frames);
+    std::atomic<size_t> next{0};
+    std::mutex output_mutex;
+    unsigned jobs = static_cast<unsigned>(std::min<size_t>(config.jobs, config.frames));
+    std::vector<std::vector<std::shared_ptr<ImageItem>>> scenes;
+    for (unsigned i = 0; i < jobs; ++i)
+        scenes.push_back(copy_scene(items));
+    auto worker = [&](unsigned job) {
+        for (size_t i = next++; i < config.frames; i = next++) {
+            reports[i] = render_frame(config, scenes[job], i);
+            std::lock_guard<std::mutex> lock(output_mutex);
+            print_report(reports[i]);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < jobs; ++i)
+        workers.emplace_back(worker, i);
+    for (auto& t : workers)
+        t.join();
+
+    size_t failed = 0;
+    for (const auto& report : reports) {
+        if (report.status == "differs" || report.status == "missing" || report.status == "error")
+            failed++;
+    }
+    std::cout << "{\"summary\":{\"scene\":\"" << json_escape(config.scene.string()) << "\",\"items\":" << items.size()
+              << ",\"frames\":" << config.frames << ",\"width\":" << config.options.width
+              << ",\"height\":" << config.options.height << ",\"failed\":" << failed
+              << ",\"diagnostics\":" << diagnostics.size() << ",\"jobs\":" << workers.size()
+              << std::fixed << std::setprecision(3) << ",\"step_ms\":" << config.step_ms
+              << ",\"load_ms\":" << load_ms << ",\"render_ms\":" << ms_since(start) << "}}" << std::endl;
+    return failed ? 1 : 0;
+}
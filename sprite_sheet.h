@@ -0,0 +1,128 @@
+#pragma once
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "asset_config.h"
+#include "atomic_file.h"
+#include "image_item.h"
+#include "atlas_packer.h"
+
+// Encodes pixbuf as PNG in memory and writes it through AtomicFileWriter, so a page gets the same
+// fsync-and-rename guarantee as the .ani that references it. Throws Glib::Error if encoding fails.
+inline bool save_png_atomically(const Glib::RefPtr<Gdk::Pixbuf>& pixbuf, const fs::path& path) {
+    gchar* buffer = nullptr;
+    gsize size = 0;
+    pixbuf->save_to_buffer(buffer, size, "png");
+    std::unique_ptr<gchar, decltype(&g_free)> owned(buffer, &g_free);
+    AtomicFileWriter writer(path);
+    writer.stream().write(buffer, static_cast<std::streamsize>(size));
+    return writer.commit();
+}
+
+struct SpriteSheetOptions {
+    int max_page_size = 4096; // Largest atlas side; more frames than fit go onto further pages
+    int padding = 1;          // Transparent pixels between frames, so filtering doesn't bleed
+};
+
+// Packs the frames of `items` into power-of-two atlas pages next to ani_path and writes one .ani
+// per item whose frame lines crop those pages, so loading it back decodes each page only once.
+// A single item is written to ani_path itself; several items to <stem>_<n>.ani. Pages are
+// <stem>.png, or <stem>_page<n>.png when there is more than one. Frames shared between items
+// (the same decoded image) are stored once. Returns false and logs to stderr on failure.
+inline bool export_sprite_sheet(const std::vector<std::shared_ptr<ImageItem>>& items, const fs::path& ani_path,
+                                const fs::path& asset_root_dir, const SpriteSheetOptions& options = {}) {
+    // Unique frames, in first-use order
+    std::vector<Glib::RefPtr<Gdk::Pixbuf>> frames;
+    std::map<const Gdk::Pixbuf*, size_t> frame_index;
+    std::vector<std::vector<size_t>> item_frames(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (items[i]->frame_count() == 0) {
+            std::cerr << "Error: item " << i << " has no frames; not exporting." << std::endl;
+            return false;
+        }
+        for (size_t f = 0; f < items[i]->frame_count(); ++f) {
+            auto pixbuf = items[i]->decoded_frame(f);
+            if (!pixbuf) {
+                std::cerr << "Error: frame " << f << " of item " << i << " is not loaded; not exporting." << std::endl;
+                return false;
+            }
+            auto [it, inserted] = frame_index.emplace(pixbuf.operator->(), frames.size());
+            if (inserted)
+                frames.push_back(pixbuf);
+            item_frames[i].push_back(it->second);
+        }
+    }
+    if (frames.empty()) {
+        std::cerr << "Error: nothing to export." << std::endl;
+        return false;
+    }
+
+    std::vector<std::pair<int, int>> sizes;
+    for (const auto& pixbuf : frames)
+        sizes.emplace_back(pixbuf->get_width(), pixbuf->get_height());
+    AtlasLayout layout = pack_atlas(sizes, options.max_page_size, options.padding);
+    for (size_t f = 0; f < frames.size(); ++f) {
+        if (layout.placements[f].page < 0) {
+            std::cerr << "Error: a " << sizes[f].first << "x" << sizes[f].second << " frame does not fit on a "
+                      << options.max_page_size << "px atlas page." << std::endl;
+            return false;
+        }
+    }
+
+    fs::path dir = ani_path.parent_path();
+    std::string stem = ani_path.stem().string();
+    std::vector<fs::path> page_paths;
+    for (size_t p = 0; p < layout.pages.size(); ++p) {
+        std::string name = layout.pages.size() == 1 ? stem + ".png" : stem + "_page" + std::to_string(p) + ".png";
+        page_paths.push_back(dir / name);
+    }
+
+    try {
+        std::vector<Glib::RefPtr<Gdk::Pixbuf>> pages;
+        for (const auto& page : layout.pages) {
+            auto pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, page.width, page.height);
+            pixbuf->fill(0x00000000);
+            pages.push_back(pixbuf);
+        }
+        for (size_t f = 0; f < frames.size(); ++f) {
+            const AtlasPlacement& p = layout.placements[f];
+            frames[f]->copy_area(0, 0, sizes[f].first, sizes[f].second, pages[p.page], p.x, p.y);
+        }
+        for (size_t p = 0; p < pages.size(); ++p) {
+            if (!save_png_atomically(pages[p], page_paths[p]))
+                return false; // AtomicFileWriter has reported it and removed its temporary file
+        }
+    } catch (const Glib::Error& ex) {
+        std::cerr << "Error: cannot write atlas page: " << ex.what() << std::endl;
+        return false;
+    }
+
+    for (size_t i = 0; i < items.size(); ++i) {
+        fs::path path = items.size() == 1 ? ani_path : dir / (stem + "_" + std::to_string(i) + ".ani");
+        AtomicFileWriter writer(path);
+        std::ostream& out = writer.stream();
+        // Same header layout the loader already accepts: size twice, then frame count and delay
+        const auto& first = sizes[item_frames[i].front()];
+        out << first.first << " " << first.second << "\n" << first.first << " " << first.second << "\n"
+            << item_frames[i].size() << " " << static_cast<int>(items[i]->frame_delay_ms) << "\n";
+        // Page sizes are powers of two, so these fractions are exact in binary and decode_frame
+        // recovers the integer crop rectangle exactly
+        out << std::setprecision(std::numeric_limits<double>::max_digits10);
+        for (size_t f : item_frames[i]) {
+            const AtlasPlacement& p = layout.placements[f];
+            const auto& page = layout.pages[p.page];
+            out << asset_relative_path(page_paths[p.page], asset_root_dir)
+                << " mins=" << double(p.x) / page.width << ",mint=" << double(p.y) / page.height
+                << ",maxs=" << double(p.x + sizes[f].first) / page.width
+                << ",maxt=" << double(p.y + sizes[f].second) / page.height << "\n";
+        }
+        if (!writer.commit())
+            return false;
+        std::cout << "Exported " << item_frames[i].size() << " frames to " << path << std::endl;
+    }
+    return true;
+}
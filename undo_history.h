@@ -0,0 +1,167 @@
+#pragma once
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "image_item.h"
+
+// The item properties that editing changes; everything else (frames, sources) is fixed per item
+struct ItemPlacement {
+    double x = 0, y = 0;
+    double scale_x = 1, scale_y = 1;
+
+    bool operator==(const ItemPlacement& other) const {
+        return x == other.x && y == other.y && scale_x == other.scale_x && scale_y == other.scale_y;
+    }
+    bool operator!=(const ItemPlacement& other) const { return !(*this == other); }
+};
+
+inline ItemPlacement placement_of(const ImageItem& item) {
+    return {item.x, item.y, item.scale_x, item.scale_y};
+}
+
+inline void apply_placement(ImageItem& item, const ItemPlacement& placement) {
+    item.x = placement.x;
+    item.y = placement.y;
+    item.scale_x = placement.scale_x;
+    item.scale_y = placement.scale_y;
+}
+
+// One item's state before and after an edit. The item is held by reference, so undoing a delete
+// brings back the same object, frames and caches included, without anything having been copied.
+struct ItemChange {
+    std::shared_ptr<ImageItem> item;
+    ItemPlacement before, after;
+    ptrdiff_t z_before = -1, z_after = -1; // position in the paint order; -1 when not in the scene
+};
+
+// One undoable action: only the items it touched
+struct EditCommand {
+    std::string label;
+    std::vector<ItemChange> changes; // in the order they were made; undone in reverse
+    size_t bytes = 0;                // filled in by EditHistory::push
+};
+
+// Undo and redo stacks of EditCommands. Undo/redo cost is proportional to the items a command
+// touched, never to the scene. History is dropped oldest first once it holds more than
+// max_entries commands or max_bytes, counting the commands themselves plus the frames of items
+// that only the history still keeps alive (deleted items, undone additions). The latest command
+// is always kept, so the last action can be undone however large it is.
+class EditHistory {
+public:
+    size_t max_bytes = 128u << 20;
+    size_t max_entries = 500;
+
+    void push(EditCommand command) {
+        if (command.changes.empty())
+            return;
+        command.bytes = command_bytes(command, true);
+        m_bytes += command.bytes;
+        m_done.push_back(std::move(command));
+        for (const auto& undone : m_undone)
+            m_bytes -= undone.bytes;
+        m_undone.clear();
+        enforce_limits();
+    }
+
+    bool can_undo() const { return !m_done.empty(); }
+    bool can_redo() const { return !m_undone.empty(); }
+
+    // The command to revert (apply each change's `before`, last change first), now on the redo
+    // stack; nullptr if there is nothing to undo. Valid until the history next changes.
+    const EditCommand* undo() {
+        if (m_done.empty())
+            return nullptr;
+        m_undone.push_back(std::move(m_done.back()));
+        m_done.pop_back();
+        recharge(m_undone.back(), false);
+        return &m_undone.back();
+    }
+
+    // The command to reapply (each change's `after`, first change first); nullptr if none
+    const EditCommand* redo() {
+        if (m_undone.empty())
+            return nullptr;
+        m_done.push_back(std::move(m_undone.back()));
+        m_undone.pop_back();
+        recharge(m_done.back(), true);
+        enforce_limits();
+        return &m_done.back();
+    }
+
+    const std::string& undo_label() const { return m_done.empty() ? m_empty : m_done.back().label; }
+    const std::string& redo_label() const { return m_undone.empty() ? m_empty : m_undone.back().label; }
+
+    void clear() {
+        m_done.clear();
+        m_undone.clear();
+        m_bytes = 0;
+    }
+
+    // Points history at `fresh` wherever it refers to `old`, e.g. after an item was reloaded
+    void replace_item(const std::shared_ptr<ImageItem>& old, const std::shared_ptr<ImageItem>& fresh) {
+        for (auto* stack : {&m_done, &m_undone}) {
+            for (auto& command : *stack) {
+                for (auto& change : command.changes) {
+                    if (change.item == old)
+                        change.item = fresh;
+                }
+            }
+        }
+    }
+
+    size_t bytes() const { return m_bytes; }
+    size_t size() const { return m_done.size() + m_undone.size(); }
+
+private:
+    // Pixel bytes of an item's frames; lazily decoded frames are owned by their store and not counted
+    static size_t frame_bytes(const ImageItem& item) {
+        std::unordered_set<const Gdk::Pixbuf*> seen;
+        size_t bytes = 0;
+        for (const auto& frame : item.frames) {
+            if (frame && seen.insert(frame.operator->()).second)
+                bytes += static_cast<size_t>(frame->get_rowstride()) * frame->get_height() * 2; // pixbuf + surface
+        }
+        return bytes;
+    }
+
+    // The command itself, plus the frames of items it leaves out of the scene in its current
+    // state: after the command while done, before it while undone. An item in the scene (e.g. one
+    // just added) is kept alive by the scene, not the history.
+    static size_t command_bytes(const EditCommand& command, bool done) {
+        size_t bytes = sizeof(EditCommand) + command.label.capacity() + command.changes.capacity() * sizeof(ItemChange);
+        std::unordered_set<const ImageItem*> seen;
+        auto charge = [&](const ItemChange& change) {
+            // An item's last change decides where a done command leaves it; its first, an undone one
+            if (!seen.insert(change.item.get()).second)
+                return;
+            if ((done ? change.z_after : change.z_before) < 0)
+                bytes += frame_bytes(*change.item);
+        };
+        if (done)
+            std::for_each(command.changes.rbegin(), command.changes.rend(), charge);
+        else
+            std::for_each(command.changes.begin(), command.changes.end(), charge);
+        return bytes;
+    }
+
+    void recharge(EditCommand& command, bool done) {
+        m_bytes -= command.bytes;
+        command.bytes = command_bytes(command, done);
+        m_bytes += command.bytes;
+    }
+
+    void enforce_limits() {
+        while (m_done.size() > 1 && (m_bytes > max_bytes || size() > max_entries)) {
+            m_bytes -= m_done.front().bytes;
+            m_done.pop_front();
+        }
+    }
+
+    std::deque<EditCommand> m_done;
+    std::deque<EditCommand> m_undone;
+    size_t m_bytes = 0;
+    const std::string m_empty;
+};
@@ -1,11 +1,28 @@
 #include <gtkmm.h>
 #include <cairomm/context.h>
+#include <chrono>
+#include <cstdlib>
 #include <vector>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include "asset_config.h"
 #include "image_item.h"
 #include "spr_parser.h"
+#include "async_spr_loader.h"
+#include "scene_renderer.h"
+#include "spatial_grid.h"
+#include "viewport.h"
+#include "drag_layers.h"
+#include "sprite_sheet.h"
+#include "layout_io.h"
+#include "scene_snapshot.h"
+#include "asset_browser.h"
+#include "file_watcher.h"
+#include "undo_history.h"
 
 class DrawingArea : public Gtk::DrawingArea {
 public:
@@ -13,98 +30,481 @@ public:
     std::shared_ptr<ImageItem> selected_image;
     sigc::signal<void()> signal_image_selected;
     sigc::signal<void()> signal_delete_pressed;
+    sigc::signal<void()> signal_scene_changed;  // Items added, removed or replaced
+    sigc::signal<void(const std::shared_ptr<ImageItem>&, const ItemPlacement&)> signal_item_dragged;  // Drag ended; placement before it
 
     double drag_offset_x = 0;
     double drag_offset_y = 0;
     bool dragging = false;
+    ItemPlacement drag_start;  // Selected item's placement when the drag began
+    DragLayers drag_layers;  // The rest of the scene, flattened while an item is dragged
 
-    size_t global_frame_index = 0;  // Shared animation frame counter
+    Viewport viewport;  // Zoom and pan; canvas <-> widget coordinates
+    bool panning = false;  // Middle-button drag in progress
+    double pan_last_x = 0, pan_last_y = 0;
+
+    guint animation_tick_id = 0;  // Frame-clock callback, 0 while nothing is animating
+
+    bool show_overlay = false;  // Performance overlay in the top-left corner
+    sigc::connection overlay_refresh;
+    size_t scene_draws = 0;  // on_draw calls that repainted canvas, not just the overlay
+    size_t overlay_last_draws = 0;
+    perf::Clock::time_point overlay_last_time;
+    double overlay_fps = 0;
+
+    SpatialGrid item_grid;  // Current item bounds, for hit-testing and culling
+    std::unordered_map<const ImageItem*, size_t> z_index;  // Position of each item in `images`
 
     DrawingArea() {
-        add_events(Gdk::BUTTON_PRESS_MASK | Gdk::BUTTON_RELEASE_MASK | Gdk::POINTER_MOTION_MASK);
+        add_events(Gdk::BUTTON_PRESS_MASK | Gdk::BUTTON_RELEASE_MASK | Gdk::POINTER_MOTION_MASK |
+                   Gdk::SCROLL_MASK | Gdk::SMOOTH_SCROLL_MASK | Gdk::KEY_PRESS_MASK);
+        // Takes the focus on click, so the zoom keys reach on_key_press_event without the
+        // window intercepting digits and '-' meant for the x/y/scale entries
+        set_can_focus(true);
     }
 
-    void set_frame_index(size_t index) {
-        global_frame_index = index;
+    // Viewport with the current widget size
+    Viewport& view() {
+        viewport.width = get_allocation().get_width();
+        viewport.height = get_allocation().get_height();
+        return viewport;
+    }
+
+    // Zoom around the widget centre
+    void zoom_by(double factor) {
+        view().zoom_at(factor, viewport.width / 2.0, viewport.height / 2.0);
         queue_draw();
     }
 
-    bool on_draw(const Cairo::RefPtr<Cairo::Context>& cr) override {
-        double width = get_allocation().get_width();
-        double height = get_allocation().get_height();
-        cr->translate(width / 2.0, height / 2.0);  // move origin to center
+    void zoom_actual_size() {
+        view().reset();
+        queue_draw();
+    }
+
+    void fit_scene() {
+        ItemBounds scene;
+        for (const auto& img : images)
+            scene = scene.united(img->bounds(img->current_frame));
+        view().fit(scene);
+        queue_draw();
+    }
+
+    // Start the frame-clock scheduler if any item has more than one frame
+    void start_animation() {
+        if (animation_tick_id)
+            return; // already running
+        bool any_animated = std::any_of(images.begin(), images.end(),
+                                        [](const auto& img) { return img->is_animated(); });
+        if (any_animated)
+            animation_tick_id = add_tick_callback(sigc::mem_fun(*this, &DrawingArea::on_animation_tick));
+    }
+
+    // Advance every animated item from its own start time and frame delay.
+    // Only items that land on a new frame are repainted; the callback removes itself when idle.
+    bool on_animation_tick(const Glib::RefPtr<Gdk::FrameClock>& frame_clock) {
+        perf::Scope timer("animation_tick");
+        gint64 now = frame_clock->get_frame_time();
+        ItemBounds visible = view().visible_canvas();
+        bool any_animated = false;
 
         for (const auto& img : images) {
-            auto pixbuf = img->get_frame(global_frame_index);
-            if (!pixbuf) continue;
-
-            double w = pixbuf->get_width() * img->scale_x;
-            double h = pixbuf->get_height() * img->scale_y;
-            auto scaled = pixbuf->scale_simple(w, h, Gdk::INTERP_BILINEAR);
-            Gdk::Cairo::set_source_pixbuf(cr, scaled, img->x - w / 2.0, img->y - h / 2.0);
-            cr->paint();
-
-            if (img->selected) {
-                cr->set_source_rgb(1.0, 0.0, 0.0);
-                cr->set_line_width(2);
-                cr->rectangle(img->x - w / 2.0, img->y - h / 2.0, w, h);
-                cr->stroke();
+            if (!img->is_animated())
+                continue;
+            any_animated = true;
+            if (img->animation_start_us < 0)
+                img->animation_start_us = now;
+
+            size_t frame = img->frame_at((now - img->animation_start_us) / 1000.0);
+            if (frame == img->current_frame)
+                continue;
+            img->current_frame = frame;
+            ItemBounds current = img->bounds(frame);
+            item_grid.update(img.get(), current);
+            ItemBounds damage = img->drawn_bounds.united(current);
+            if (damage.intersects(visible.left, visible.top, visible.left + visible.width, visible.top + visible.height)) {
+                if (img != selected_image)
+                    drag_layers.mark_dirty(damage);
+                invalidate_bounds(damage);
+            }
+        }
+
+        if (!any_animated) {
+            animation_tick_id = 0;
+            return false;
+        }
+        return true;
+    }
+
+    // Queue a repaint of a canvas-space box, padded for the selection outline
+    void invalidate_bounds(const ItemBounds& b) {
+        if (b.empty()) return;
+        const double pad = 2.0;
+        double wx1, wy1, wx2, wy2;
+        view().to_widget(b.left, b.top, wx1, wy1);
+        viewport.to_widget(b.left + b.width, b.top + b.height, wx2, wy2);
+        int x1 = static_cast<int>(std::floor(wx1 - pad));
+        int y1 = static_cast<int>(std::floor(wy1 - pad));
+        int x2 = static_cast<int>(std::ceil(wx2 + pad));
+        int y2 = static_cast<int>(std::ceil(wy2 + pad));
+        queue_draw_area(x1, y1, x2 - x1, y2 - y1);
+    }
+
+    // Repaint where the item was last drawn and where it is now. Every change to an item's
+    // position, scale or frames goes through here, which also keeps item_grid current.
+    void invalidate_item(const std::shared_ptr<ImageItem>& img) {
+        ItemBounds current = img->bounds(img->current_frame);
+        item_grid.update(img.get(), current);
+        if (img != selected_image)
+            drag_layers.mark_dirty(img->drawn_bounds.united(current));
+        invalidate_bounds(img->drawn_bounds.united(current));
+    }
+
+    void reindex_images() {
+        z_index.clear();
+        for (size_t i = 0; i < images.size(); ++i)
+            z_index[images[i].get()] = i;
+    }
+
+    void add_image(const std::shared_ptr<ImageItem>& img) {
+        images.push_back(img);
+        z_index[img.get()] = images.size() - 1;
+        drag_layers.reset();
+        invalidate_item(img);
+        signal_scene_changed.emit();
+    }
+
+    void remove_image(const std::shared_ptr<ImageItem>& img) {
+        images.erase(std::remove(images.begin(), images.end(), img), images.end());
+        item_grid.remove(img.get());
+        reindex_images();
+        drag_layers.reset();
+        invalidate_bounds(img->drawn_bounds);
+        if (selected_image == img) {
+            selected_image.reset();
+            dragging = false;
+        }
+        signal_scene_changed.emit();
+    }
+
+    // Put `fresh` where `old` is in the paint order (and selection), e.g. after reloading its file
+    void replace_image(const std::shared_ptr<ImageItem>& old, const std::shared_ptr<ImageItem>& fresh) {
+        auto z = z_index.find(old.get());
+        if (z == z_index.end())
+            return;
+        images[z->second] = fresh;
+        z_index.erase(z);
+        reindex_images();
+        drag_layers.reset();
+        item_grid.remove(old.get());
+        invalidate_bounds(old->drawn_bounds);
+        invalidate_item(fresh);
+        if (selected_image == old) {
+            selected_image = fresh;
+            fresh->selected = true;
+        }
+        signal_scene_changed.emit();
+    }
+
+    // Move an item to the end of the paint order (drawn last, on top) or to the start (bottom)
+    void restack_image(const std::shared_ptr<ImageItem>& img, bool to_end) {
+        images.erase(std::remove(images.begin(), images.end(), img), images.end());
+        if (to_end)
+            images.push_back(img);
+        else
+            images.insert(images.begin(), img);
+        reindex_images();
+        drag_layers.reset();
+        invalidate_item(img);
+    }
+
+    // Puts an item at position z of the paint order, adding it to the scene if needed; z < 0
+    // removes it. Used to replay history, so positions are those recorded at the time.
+    void place_image(const std::shared_ptr<ImageItem>& img, ptrdiff_t z) {
+        bool present = z_index.count(img.get()) != 0;
+        if (z < 0) {
+            if (present) remove_image(img);
+            return;
+        }
+        if (present)
+            images.erase(images.begin() + z_index[img.get()]);
+        images.insert(images.begin() + std::min<size_t>(z, images.size()), img);
+        reindex_images();
+        drag_layers.reset();
+        invalidate_item(img);
+        if (!present)
+            signal_scene_changed.emit();
+    }
+
+    ptrdiff_t z_of(const std::shared_ptr<ImageItem>& img) const {
+        auto z = z_index.find(img.get());
+        return z == z_index.end() ? -1 : static_cast<ptrdiff_t>(z->second);
+    }
+
+    // Items overlapping a canvas-space rectangle, in paint order (bottom first)
+    std::vector<std::shared_ptr<ImageItem>> items_in_rect(double x1, double y1, double x2, double y2) const {
+        std::vector<const ImageItem*> candidates;
+        item_grid.query(x1, y1, x2, y2, candidates);
+        std::vector<size_t> order;
+        order.reserve(candidates.size());
+        for (const ImageItem* candidate : candidates) {
+            auto z = z_index.find(candidate);
+            if (z != z_index.end())
+                order.push_back(z->second);
+        }
+        std::sort(order.begin(), order.end());
+        std::vector<std::shared_ptr<ImageItem>> result;
+        result.reserve(order.size());
+        for (size_t index : order)
+            result.push_back(images[index]);
+        return result;
+    }
+
+    // Splits the items overlapping a canvas box into those painted before and after `z`
+    void items_around(const ItemBounds& b, size_t z, std::vector<std::shared_ptr<ImageItem>>& below,
+                      std::vector<std::shared_ptr<ImageItem>>& above) const {
+        below.clear();
+        above.clear();
+        for (auto& img : items_in_rect(b.left, b.top, b.left + b.width, b.top + b.height)) {
+            size_t index = z_index.at(img.get());
+            if (index < z)
+                below.push_back(std::move(img));
+            else if (index > z)
+                above.push_back(std::move(img));
+        }
+    }
+
+    // Dragging repaints only the moving item; the rest comes from drag_layers, built on the first
+    // draw of the drag and patched where other items changed since
+    void draw_dragged(const Cairo::RefPtr<Cairo::Context>& cr, const Cairo::Matrix& widget_matrix) {
+        size_t z = z_index.at(selected_image.get());
+        std::vector<std::shared_ptr<ImageItem>> below, above;
+        if (!drag_layers.valid_for(selected_image.get(), viewport, get_scale_factor())) {
+            items_around(viewport.visible_canvas(), z, below, above);
+            drag_layers.build(cr->get_target(), selected_image.get(), viewport, get_scale_factor(), below, above);
+        }
+        for (const auto& b : drag_layers.dirty()) {
+            items_around(b, z, below, above);
+            drag_layers.refresh(b, below, above);
+        }
+        drag_layers.clear_dirty();
+        drag_layers.paint(cr, widget_matrix, selected_image);
+    }
+
+    bool on_draw(const Cairo::RefPtr<Cairo::Context>& cr) override {
+        Cairo::Matrix widget_matrix;
+        cr->get_matrix(widget_matrix);
+        // The overlay's own twice-a-second refresh is neither a frame nor a scene draw to time
+        double wx1, wy1, wx2, wy2;
+        cr->get_clip_extents(wx1, wy1, wx2, wy2);
+        bool overlay_only = show_overlay && wx2 <= overlay_width && wy2 <= overlay_height;
+        if (!overlay_only)
+            scene_draws++;
+        {
+            perf::Scope timer(overlay_only ? "overlay_draw" : "on_draw", "draw");
+            view().apply(cr);  // user space is now canvas space
+
+            if (dragging && selected_image) {
+                draw_dragged(cr, widget_matrix);
+            } else {
+                double clip_x1, clip_y1, clip_x2, clip_y2;
+                cr->get_clip_extents(clip_x1, clip_y1, clip_x2, clip_y2);
+                perf::counter("items_drawn", draw_items(cr, items_in_rect(clip_x1, clip_y1, clip_x2, clip_y2), viewport.zoom));
             }
         }
+        if (show_overlay)
+            draw_overlay(cr, widget_matrix);
         return true;
     }
 
+    // --- Performance overlay ---
+    static constexpr int overlay_width = 230, overlay_height = 76;
+
+    void set_overlay(bool on) {
+        show_overlay = on;
+        perf::Recorder::instance().set_overlay(on);
+        overlay_refresh.disconnect();
+        if (on) {
+            overlay_last_draws = scene_draws;
+            overlay_last_time = perf::Clock::now();
+            overlay_refresh = Glib::signal_timeout().connect(sigc::mem_fun(*this, &DrawingArea::on_overlay_refresh), 500);
+        }
+        queue_draw_area(0, 0, overlay_width, overlay_height);
+    }
+
+    // Twice a second: work out the draw rate since last time and repaint the overlay
+    bool on_overlay_refresh() {
+        auto now = perf::Clock::now();
+        double seconds = std::chrono::duration<double>(now - overlay_last_time).count();
+        overlay_fps = seconds > 0 ? (scene_draws - overlay_last_draws) / seconds : 0;
+        overlay_last_draws = scene_draws;
+        overlay_last_time = now;
+        perf::counter("resident_bytes", double(resident_bytes()));
+        queue_draw_area(0, 0, overlay_width, overlay_height);
+        return true;
+    }
+
+    // Memory behind the scene: cached source images (pixels and charged surfaces), then for each
+    // distinct frame its own pixels (not a crop view into a cached image), its premultiplied
+    // surface unless the cache counted it, its mip levels, and each item's scaled copies
+    size_t resident_bytes() const {
+        auto ranges = ImageCache::instance().pixel_ranges();
+        size_t bytes = ImageCache::instance().resident_bytes();
+        std::unordered_set<const void*> seen;
+        auto count_surface = [&](const Cairo::RefPtr<Cairo::ImageSurface>& surface) {
+            if (surface && seen.insert(surface->cobj()).second)
+                bytes += static_cast<size_t>(surface->get_stride()) * surface->get_height();
+        };
+        auto count_frame = [&](const Glib::RefPtr<Gdk::Pixbuf>& frame) {
+            if (!frame || frame == frame_placeholder() || !seen.insert(frame->gobj()).second)
+                return;
+            const guint8* pixels = frame->get_pixels();
+            auto range = std::upper_bound(ranges.begin(), ranges.end(), pixels,
+                                          [](const guint8* p, const ImageCache::PixelRange& r) { return p < r.pixels; });
+            bool cached = false, view = false;
+            if (range != ranges.begin()) {
+                --range;
+                view = pixels < range->pixels + range->bytes;
+                cached = view && range->pixbuf == frame->gobj();
+            }
+            if (!view)
+                bytes += static_cast<size_t>(frame->get_rowstride()) * frame->get_height();
+            auto surface = attached_surface(frame);
+            if (cached && surface)
+                seen.insert(surface->cobj()); // charged by ImageCache
+            else
+                count_surface(surface);
+            if (const MipPyramid* pyramid = attached_mip_pyramid(frame))
+                bytes += pyramid->extra_bytes();
+        };
+        for (const auto& img : images) {
+            if (img->lazy_frames) {
+                for (size_t i = 0; i < img->lazy_frames->size(); ++i)
+                    count_frame(img->lazy_frames->resident(i));
+            } else {
+                for (const auto& frame : img->frames)
+                    count_frame(frame);
+            }
+            for (const auto& scaled : img->scaled_cache)
+                count_surface(scaled);
+        }
+        return bytes;
+    }
+
+    void draw_overlay(const Cairo::RefPtr<Cairo::Context>& cr, const Cairo::Matrix& widget_matrix) {
+        auto& recorder = perf::Recorder::instance();
+        char lines[4][64];
+        std::snprintf(lines[0], sizeof(lines[0]), "FPS %.1f", overlay_fps);
+        std::snprintf(lines[1], sizeof(lines[1]), "draw %.2f ms (last %.2f)", recorder.stat("on_draw").average_ms,
+                      recorder.stat("on_draw").last_ms);
+        std::snprintf(lines[2], sizeof(lines[2]), "items drawn %.0f", recorder.counter_value("items_drawn"));
+        std::snprintf(lines[3], sizeof(lines[3]), "decoded %.1f MiB resident", recorder.counter_value("resident_bytes") / (1 << 20));
+        cr->save();
+        cr->set_matrix(widget_matrix);
+        cr->set_source_rgba(0, 0, 0, 0.6);
+        cr->rectangle(0, 0, overlay_width, overlay_height);
+        cr->fill();
+        cr->set_source_rgb(1, 1, 1);
+        cr->set_font_size(12);
+        for (int i = 0; i < 4; ++i) {
+            cr->move_to(8, 16 + i * 17);
+            cr->show_text(lines[i]);
+        }
+        cr->restore();
+    }
+
     bool on_key_press_event(GdkEventKey* event) override {
         if (event->keyval == GDK_KEY_Delete) {
             std::cout << "Delete key pressed." << std::endl;
             signal_delete_pressed.emit();
             return true;
         }
+        switch (event->keyval) {
+            case GDK_KEY_plus: case GDK_KEY_equal: case GDK_KEY_KP_Add: zoom_by(1.25); return true;
+            case GDK_KEY_minus: case GDK_KEY_KP_Subtract: zoom_by(0.8); return true;
+            case GDK_KEY_0: fit_scene(); return true;
+            case GDK_KEY_1: zoom_actual_size(); return true;
+        }
         return Gtk::DrawingArea::on_key_press_event(event);
     }
 
     bool on_button_press_event(GdkEventButton* event) override {
-        double cx = get_allocation().get_width() / 2.0;
-        double cy = get_allocation().get_height() / 2.0;
-        double ex = event->x - cx;
-        double ey = event->y - cy;
+        grab_focus();
+        if (event->button == 2) {
+            panning = true;
+            pan_last_x = event->x;
+            pan_last_y = event->y;
+            return true;
+        }
+        double ex, ey;
+        view().to_canvas(event->x, event->y, ex, ey);
 
-        for (auto& img : images) {
-            img->selected = false;
+        if (selected_image) {
+            selected_image->selected = false;
+            invalidate_item(selected_image);
         }
-        for (auto it = images.rbegin(); it != images.rend(); ++it) {
-            if ((*it)->contains(ex, ey, global_frame_index)) {
+        perf::Scope hit_timer("hit_test");
+        auto candidates = items_in_rect(ex, ey, ex, ey);
+        for (auto it = candidates.rbegin(); it != candidates.rend(); ++it) {
+            if ((*it)->contains(ex, ey, (*it)->current_frame)) {
                 selected_image = *it;
                 selected_image->selected = true;
                 drag_offset_x = ex - selected_image->x;
                 drag_offset_y = ey - selected_image->y;
                 dragging = true;
+                drag_start = placement_of(*selected_image);
+                invalidate_item(selected_image);
                 signal_image_selected.emit();
                 break;
             }
         }
-        queue_draw();
         return true;
     }
 
     bool on_button_release_event(GdkEventButton* event) override {
-        dragging = false;
+        if (event->button == 2) {
+            panning = false;
+        } else {
+            // The whole drag is one history entry, however many motion events it took
+            if (dragging && selected_image && placement_of(*selected_image) != drag_start)
+                signal_item_dragged.emit(selected_image, drag_start);
+            dragging = false;
+            drag_layers.reset();
+        }
         return true;
     }
 
     bool on_motion_notify_event(GdkEventMotion* event) override {
-        if (dragging && selected_image) {
-            double cx = get_allocation().get_width() / 2.0;
-            double cy = get_allocation().get_height() / 2.0;
-            double ex = event->x - cx;
-            double ey = event->y - cy;
+        if (panning) {
+            view().pan_by(event->x - pan_last_x, event->y - pan_last_y);
+            pan_last_x = event->x;
+            pan_last_y = event->y;
+            queue_draw();
+        } else if (dragging && selected_image) {
+            double ex, ey;
+            view().to_canvas(event->x, event->y, ex, ey);
             selected_image->x = ex - drag_offset_x;
             selected_image->y = ey - drag_offset_y;
             signal_image_selected.emit();
-            queue_draw();
+            invalidate_item(selected_image);
         }
         return true;
     }
+
+    // Wheel zooms around the pointer
+    bool on_scroll_event(GdkEventScroll* event) override {
+        double steps = 0;
+        if (event->direction == GDK_SCROLL_UP)
+            steps = 1;
+        else if (event->direction == GDK_SCROLL_DOWN)
+            steps = -1;
+        else if (event->direction == GDK_SCROLL_SMOOTH)
+            steps = -event->delta_y;
+        if (steps == 0)
+            return false;
+        view().zoom_at(std::pow(1.25, steps), event->x, event->y);
+        queue_draw();
+        return true;
+    }
 };
 
 class MainWindow : public Gtk::Window {
@@ -122,10 +522,18 @@ class MainWindow : public Gtk::Window {
     Gtk::Box controls{Gtk::ORIENTATION_VERTICAL};
     Gtk::Entry x_entry, y_entry, xscale_entry, yscale_entry;
     Gtk::Label x_label{"X:"}, y_label{"Y:"}, xscale_label{"X Scale:"}, yscale_label{"Y Scale:"};
-    size_t animation_frame_index = 0;
-    sigc::connection animation_timer;
+    FrameLoader frame_loader;  // Decodes animation frames off the main thread
+    Gtk::CheckMenuItem item_save_snapshot{"Save Scene _Snapshot With Layouts", true};
+    Gtk::CheckMenuItem item_overlay{"Performance _Overlay", true};
+    FileWatcher file_watcher;  // Every file the scene's items were loaded from
+    sigc::connection watch_update;  // Pending idle refresh of the watched set
+    EditHistory history;
+    Gtk::MenuItem* item_undo = nullptr;
+    Gtk::MenuItem* item_redo = nullptr;
 protected:
     fs::path m_asset_root_dir;
+    Gtk::Paned browser_paned{Gtk::ORIENTATION_HORIZONTAL};
+    AssetBrowser asset_browser{m_asset_root_dir};
 public:
     MainWindow(const fs::path& asset_root_dir)
         : m_asset_root_dir(asset_root_dir) {
@@ -161,12 +569,51 @@ public:
         auto item_save_base = Gtk::manage(new Gtk::MenuItem("Save _Base", true));
         item_save_base->signal_activate().connect(sigc::mem_fun(*this, &MainWindow::on_menu_file_save_base));
         file_menu->append(*item_save_base);
+        item_save_snapshot.set_active(true);
+        file_menu->append(item_save_snapshot);
+        auto item_export_sheet = Gtk::manage(new Gtk::MenuItem("_Export Sprite Sheet...", true));
+        item_export_sheet->signal_activate().connect(sigc::mem_fun(*this, &MainWindow::on_menu_file_export_sheet));
+        file_menu->append(*item_export_sheet);
+        auto item_export_atlas = Gtk::manage(new Gtk::MenuItem("Export Scene _Atlas...", true));
+        item_export_atlas->signal_activate().connect(sigc::mem_fun(*this, &MainWindow::on_menu_file_export_atlas));
+        file_menu->append(*item_export_atlas);
         auto item_quit = Gtk::manage(new Gtk::MenuItem("_Quit", true));
         item_quit->signal_activate().connect(sigc::mem_fun(*this, &MainWindow::on_menu_file_quit));
         file_menu->append(*item_quit);
         menu_bar->append(*item_file);
+        auto edit_menu = Gtk::manage(new Gtk::Menu());
+        auto item_edit = Gtk::manage(new Gtk::MenuItem("_Edit", true));
+        item_edit->set_submenu(*edit_menu);
+        item_undo = Gtk::manage(new Gtk::MenuItem("_Undo (Ctrl+Z)", true));
+        item_undo->signal_activate().connect(sigc::mem_fun(*this, &MainWindow::on_undo));
+        edit_menu->append(*item_undo);
+        item_redo = Gtk::manage(new Gtk::MenuItem("_Redo (Ctrl+Y)", true));
+        item_redo->signal_activate().connect(sigc::mem_fun(*this, &MainWindow::on_redo));
+        edit_menu->append(*item_redo);
+        menu_bar->append(*item_edit);
+        update_history_actions();
+        auto view_menu = Gtk::manage(new Gtk::Menu());
+        auto item_view = Gtk::manage(new Gtk::MenuItem("_View", true));
+        item_view->set_submenu(*view_menu);
+        auto item_zoom_in = Gtk::manage(new Gtk::MenuItem("Zoom _In (+)", true));
+        item_zoom_in->signal_activate().connect([this] { drawing_area.zoom_by(1.25); });
+        view_menu->append(*item_zoom_in);
+        auto item_zoom_out = Gtk::manage(new Gtk::MenuItem("Zoom _Out (-)", true));
+        item_zoom_out->signal_activate().connect([this] { drawing_area.zoom_by(0.8); });
+        view_menu->append(*item_zoom_out);
+        auto item_actual_size = Gtk::manage(new Gtk::MenuItem("_Actual Size (1)", true));
+        item_actual_size->signal_activate().connect([this] { drawing_area.zoom_actual_size(); });
+        view_menu->append(*item_actual_size);
+        auto item_fit = Gtk::manage(new Gtk::MenuItem("_Fit Scene (0)", true));
+        item_fit->signal_activate().connect([this] { drawing_area.fit_scene(); });
+        view_menu->append(*item_fit);
+        item_overlay.signal_toggled().connect([this] { drawing_area.set_overlay(item_overlay.get_active()); });
+        view_menu->append(item_overlay);
+        menu_bar->append(*item_view);
         vbox.pack_start(*menu_bar, Gtk::PACK_SHRINK);
-        vbox.pack_start(vpaned);
+        vbox.pack_start(browser_paned);
+        browser_paned.add1(asset_browser);
+        browser_paned.add2(vpaned);
         vpaned.add1(drawing_area);
         vpaned.add2(hpaned);
         hpaned.add1(buttons);
@@ -195,6 +642,13 @@ public:
         y_entry.signal_activate().connect(sigc::mem_fun(*this, &MainWindow::on_input_changed));
         xscale_entry.signal_activate().connect(sigc::mem_fun(*this, &MainWindow::on_input_changed));
         yscale_entry.signal_activate().connect(sigc::mem_fun(*this, &MainWindow::on_input_changed));
+        drawing_area.signal_scene_changed.connect(sigc::mem_fun(*this, &MainWindow::schedule_watch_update));
+        file_watcher.signal_changed.connect(sigc::mem_fun(*this, &MainWindow::on_watched_files_changed));
+        asset_browser.signal_asset_activated.connect([this](const fs::path& path) { add_file_with_undo(path); });
+        drawing_area.signal_item_dragged.connect([this](const std::shared_ptr<ImageItem>& img, const ItemPlacement& before) {
+            ptrdiff_t z = drawing_area.z_of(img);
+            record_edit({"Move", {{img, before, placement_of(*img), z, z}}});
+        });
         drawing_area.signal_image_selected.connect(sigc::mem_fun(*this, &MainWindow::on_image_selected));
         
         bring_front_button.signal_clicked().connect(sigc::mem_fun(*this, &MainWindow::on_bring_to_front));
@@ -203,21 +657,297 @@ public:
         show_all_children();
     }
 
-    void on_menu_file_open() { /* TODO */ }
-    void on_menu_file_save_spr() { /* TODO */ }
-    void on_menu_file_save_cpt() { /* TODO */ }
-    void on_menu_file_save_base() { /* TODO */ }
+    // Opens a base (.py) or cockpit (.cpt) layout in place of the current scene, or adds a single
+    // sprite or image to it
+    void on_menu_file_open() {
+        Gtk::FileChooserDialog dialog(*this, "Open", Gtk::FILE_CHOOSER_ACTION_OPEN);
+        dialog.add_button("Cancel", Gtk::RESPONSE_CANCEL);
+        dialog.add_button("Open", Gtk::RESPONSE_OK);
+
+        auto filter = Gtk::FileFilter::create();
+        filter->set_name("Layouts, Sprites and Images");
+        for (const char* pattern : {"*.py", "*.cpt", "*.spr", "*.ani", "*.png", "*.dds"})
+            filter->add_pattern(pattern);
+        dialog.add_filter(filter);
+        if (dialog.run() != Gtk::RESPONSE_OK)
+            return;
+
+        fs::path path = dialog.get_filename();
+        if (path.extension() == ".py" || path.extension() == ".cpt") {
+            if (open_snapshot(path))
+                return;
+            std::vector<LayoutEntry> entries;
+            if (!read_layout(path, m_asset_root_dir, current_canvas(), entries))
+                return;
+            history.clear();
+            update_history_actions();
+            for (const auto& img : std::vector<std::shared_ptr<ImageItem>>(drawing_area.images))
+                drawing_area.remove_image(img);
+            for (const auto& entry : entries) {
+                auto img = add_file(entry.source);
+                if (!img) continue;
+                img->x = entry.x;
+                img->y = entry.y;
+                img->scale_x = entry.scale_x;
+                img->scale_y = entry.scale_y;
+                drawing_area.invalidate_item(img);
+            }
+        } else {
+            add_file_with_undo(path);
+        }
+    }
+
+    void on_menu_file_save_spr() {
+        auto img = drawing_area.selected_image;
+        if (!img) {
+            std::cerr << "Select a sprite to save." << std::endl;
+            return;
+        }
+        fs::path path = choose_save_path("Save Sprite", img->is_animation ? "sprite.ani" : "sprite.spr",
+                                         "Sprite Files", {"*.spr", "*.ani"});
+        if (!path.empty() && write_sprite_file(*img, path, m_asset_root_dir))
+            std::cout << "Saved sprite to " << path << std::endl;
+    }
+
+    void on_menu_file_save_cpt() {
+        fs::path path = choose_save_path("Save Cockpit", "cockpit.cpt", "Cockpit Files", {"*.cpt"});
+        if (!path.empty() && write_cockpit_layout(drawing_area.images, path, m_asset_root_dir, current_canvas())) {
+            std::cout << "Saved cockpit to " << path << std::endl;
+            save_snapshot(path);
+        }
+    }
+
+    void on_menu_file_save_base() {
+        fs::path path = choose_save_path("Save Base", "base.py", "Base Scripts", {"*.py"});
+        if (!path.empty() && write_base_layout(drawing_area.images, path, m_asset_root_dir, current_canvas())) {
+            std::cout << "Saved base to " << path << std::endl;
+            save_snapshot(path);
+        }
+    }
+
+    void save_snapshot(const fs::path& layout_path) {
+        if (item_save_snapshot.get_active() && write_scene_snapshot(drawing_area.images, layout_path))
+            std::cout << "Saved scene snapshot to " << snapshot_path_for(layout_path) << std::endl;
+    }
+
+    // Replaces the scene with the snapshot saved alongside layout_path. Returns false if there is
+    // no usable snapshot, leaving the scene untouched.
+    bool open_snapshot(const fs::path& layout_path) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::shared_ptr<ImageItem>> items;
+        bool ok = read_scene_snapshot(layout_path, frame_loader,
+            [this](const std::shared_ptr<ImageItem>& item, size_t) {
+                drawing_area.invalidate_item(item);
+            }, items);
+        if (!ok)
+            return false;
+        history.clear();
+        update_history_actions();
+        for (const auto& img : std::vector<std::shared_ptr<ImageItem>>(drawing_area.images))
+            drawing_area.remove_image(img);
+        for (const auto& img : items)
+            drawing_area.add_image(img);
+        drawing_area.start_animation();
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Opened " << items.size() << " items from " << snapshot_path_for(layout_path) << " in " << ms
+                  << " ms" << std::endl;
+        return true;
+    }
+
+    fs::path choose_save_path(const std::string& title, const std::string& default_name,
+                              const std::string& filter_name, std::initializer_list<const char*> patterns) {
+        Gtk::FileChooserDialog dialog(*this, title, Gtk::FILE_CHOOSER_ACTION_SAVE);
+        dialog.add_button("Cancel", Gtk::RESPONSE_CANCEL);
+        dialog.add_button("Save", Gtk::RESPONSE_OK);
+        dialog.set_do_overwrite_confirmation(true);
+        dialog.set_current_name(default_name);
+
+        auto filter = Gtk::FileFilter::create();
+        filter->set_name(filter_name);
+        for (const char* pattern : patterns)
+            filter->add_pattern(pattern);
+        dialog.add_filter(filter);
+        if (dialog.run() != Gtk::RESPONSE_OK)
+            return {};
+        return dialog.get_filename();
+    }
+
+    LayoutCanvas current_canvas() const {
+        auto allocation = drawing_area.get_allocation();
+        if (allocation.get_width() <= 0 || allocation.get_height() <= 0)
+            return {};
+        return {double(allocation.get_width()), double(allocation.get_height())};
+    }
+
+    // Loads a sprite (.spr/.ani) or a plain image and adds it to the scene
+    std::shared_ptr<ImageItem> add_file(const fs::path& path) {
+        if (path.extension() == ".spr" || path.extension() == ".ani") {
+            auto image = load_spr_file_async(path.string(), m_asset_root_dir, frame_loader,
+                [this](const std::shared_ptr<ImageItem>& item, size_t) {
+                    drawing_area.invalidate_item(item);
+                });
+            if (!image || image->frame_count() == 0) {
+                std::cerr << "No frames loaded from SPR file." << std::endl;
+                return nullptr;
+            }
+            drawing_area.add_image(image);
+            drawing_area.start_animation();
+            return image;
+        }
+
+        auto image = std::make_shared<ImageItem>();
+        try {
+            auto pixbuf = ImageCache::instance().get(path);
+            premultiplied_surface_for(pixbuf);
+            ImageCache::instance().charge_attached_surface(pixbuf);
+            opacity_mask_for(pixbuf);
+            image->frames.push_back(pixbuf);  // single-frame PNG
+            image->source_path = path;
+            drawing_area.add_image(image);
+        } catch (const Glib::Error& ex) {
+            std::cerr << "Failed to load PNG: " << ex.what() << std::endl;
+            return nullptr;
+        }
+        return image;
+    }
     void on_menu_file_quit() { hide(); }
 
-    void start_animation_timer() {
-        if (animation_timer.connected())
-            return; // already running
+    // --- Hot reload ---
+    // The watched set follows the scene; many additions (opening a layout) make one update
+    void schedule_watch_update() {
+        if (watch_update.connected())
+            return;
+        watch_update = Glib::signal_idle().connect([this] {
+            std::set<fs::path> files;
+            for (const auto& img : drawing_area.images) {
+                if (!img->source_path.empty()) files.insert(img->source_path);
+                for (const auto& info : img->frame_infos) {
+                    files.insert(info.image_path);
+                    if (!info.alpha_mask_path.empty()) files.insert(info.alpha_mask_path);
+                }
+            }
+            file_watcher.watch(files);
+            return false;
+        });
+    }
 
-        animation_timer = Glib::signal_timeout().connect([this]() {
-            animation_frame_index++;
-            drawing_area.set_frame_index(animation_frame_index);  // assumes this method already exists
-            return true; // continue running
-        }, 100); // 100ms = 10 FPS
+    // An edited .spr/.ani is parsed again and its item replaced; otherwise only the frames whose
+    // image or mask changed are decoded again, in the background, and swapped in when ready
+    void on_watched_files_changed(const std::set<fs::path>& changed) {
+        for (const auto& img : std::vector<std::shared_ptr<ImageItem>>(drawing_area.images)) {
+            bool is_sprite = img->source_path.extension() == ".spr" || img->source_path.extension() == ".ani";
+            if (is_sprite && changed.count(watch_key(img->source_path))) {
+                reload_sprite(img);
+                continue;
+            }
+            if (img->frame_infos.empty()) {
+                if (!img->source_path.empty() && changed.count(watch_key(img->source_path)))
+                    reload_frame(img, 0, ParsedFrameInfo{img->source_path});
+                continue;
+            }
+            for (size_t f = 0; f < img->frame_infos.size(); ++f) {
+                const ParsedFrameInfo& info = img->frame_infos[f];
+                if (changed.count(watch_key(info.image_path)) ||
+                    (!info.alpha_mask_path.empty() && changed.count(watch_key(info.alpha_mask_path))))
+                    reload_frame(img, f, info);
+            }
+        }
+    }
+
+    void reload_frame(const std::shared_ptr<ImageItem>& img, size_t index, const ParsedFrameInfo& info) {
+        std::weak_ptr<ImageItem> weak_item = img;
+        frame_loader.submit(
+            [info]() -> Glib::RefPtr<Gdk::Pixbuf> {
+                try {
+                    return decode_frame(info);
+                } catch (const Glib::Error& ex) {
+                    // Often a save still in progress; the next write triggers another reload
+                    std::cerr << "Cannot reload '" << info.image_path << "': " << ex.what() << std::endl;
+                    return {};
+                }
+            },
+            [this, weak_item, index](Glib::RefPtr<Gdk::Pixbuf> pixbuf) {
+                auto item = weak_item.lock();
+                if (!item || !pixbuf)
+                    return; // removed meanwhile, or keep showing the old frame
+                item->replace_frame(index, pixbuf);
+                drawing_area.invalidate_item(item);
+            });
+    }
+
+    void reload_sprite(const std::shared_ptr<ImageItem>& old) {
+        auto fresh = load_spr_file_async(old->source_path.string(), m_asset_root_dir, frame_loader,
+            [this](const std::shared_ptr<ImageItem>& item, size_t) {
+                drawing_area.invalidate_item(item);
+            });
+        if (!fresh || fresh->frame_count() == 0) {
+            std::cerr << "Cannot reload " << old->source_path << "; keeping the loaded version." << std::endl;
+            return;
+        }
+        // Frames whose line didn't change stay on screen until their (cached) decode lands
+        auto same = [](const ParsedFrameInfo& a, const ParsedFrameInfo& b) {
+            return a.image_path == b.image_path && a.alpha_mask_path == b.alpha_mask_path &&
+                   a.has_alpha_mask_in_frame_line == b.has_alpha_mask_in_frame_line && a.has_cropping == b.has_cropping &&
+                   a.mins == b.mins && a.mint == b.mint && a.maxs == b.maxs && a.maxt == b.maxt;
+        };
+        if (!fresh->lazy_frames && !old->lazy_frames) {
+            for (size_t f = 0; f < std::min(fresh->frames.size(), old->frames.size()); ++f) {
+                if (f < old->frame_infos.size() && f < fresh->frame_infos.size() && fresh->frames[f] == frame_placeholder() &&
+                    same(old->frame_infos[f], fresh->frame_infos[f]))
+                    fresh->frames[f] = old->frames[f];
+            }
+        }
+        fresh->x = old->x;
+        fresh->y = old->y;
+        fresh->scale_x = old->scale_x;
+        fresh->scale_y = old->scale_y;
+        fresh->animation_start_us = old->animation_start_us;
+        drawing_area.replace_image(old, fresh);
+        history.replace_item(old, fresh);
+        drawing_area.start_animation();
+        std::cout << "Reloaded " << old->source_path << std::endl;
+    }
+
+    void on_menu_file_export_sheet() {
+        if (!drawing_area.selected_image) {
+            std::cerr << "Select a sprite to export." << std::endl;
+            return;
+        }
+        export_items({drawing_area.selected_image}, "Export Sprite Sheet");
+    }
+
+    void on_menu_file_export_atlas() {
+        if (drawing_area.images.empty()) return;
+        export_items(drawing_area.images, "Export Scene Atlas");
+    }
+
+    void export_items(const std::vector<std::shared_ptr<ImageItem>>& items, const std::string& title) {
+        for (const auto& item : items) {
+            for (const auto& frame : item->frames) {
+                if (frame == frame_placeholder()) {
+                    std::cerr << "Frames are still loading; try again in a moment." << std::endl;
+                    return;
+                }
+            }
+        }
+
+        Gtk::FileChooserDialog dialog(*this, title, Gtk::FILE_CHOOSER_ACTION_SAVE);
+        dialog.add_button("Cancel", Gtk::RESPONSE_CANCEL);
+        dialog.add_button("Save", Gtk::RESPONSE_OK);
+        dialog.set_do_overwrite_confirmation(true);
+        dialog.set_current_name("sprite.ani");
+
+        auto filter = Gtk::FileFilter::create();
+        filter->set_name("Animation Files");
+        filter->add_pattern("*.ani");
+        dialog.add_filter(filter);
+
+        if (dialog.run() == Gtk::RESPONSE_OK) {
+            fs::path path = dialog.get_filename();
+            if (path.extension() != ".ani")
+                path += ".ani";
+            export_sprite_sheet(items, path, m_asset_root_dir);
+        }
     }
 
     void on_add_png_clicked() {
@@ -227,19 +957,11 @@ public:
 
         auto filter = Gtk::FileFilter::create();
         filter->add_mime_type("image/png");
+        filter->add_pattern("*.dds");
         dialog.add_filter(filter);
     
-        if (dialog.run() == Gtk::RESPONSE_OK) {
-        auto image = std::make_shared<ImageItem>();
-            try {
-            auto pixbuf = Gdk::Pixbuf::create_from_file(dialog.get_filename());
-                image->frames.push_back(pixbuf);  // single-frame PNG
-                drawing_area.images.push_back(image);
-                drawing_area.queue_draw();
-            } catch (const Glib::Error& ex) {
-                std::cerr << "Failed to load PNG: " << ex.what() << std::endl;
-            }
-        }
+        if (dialog.run() == Gtk::RESPONSE_OK)
+            add_file_with_undo(dialog.get_filename());
     }
  
     void on_add_spr_clicked() {
@@ -253,23 +975,22 @@ public:
         filter->add_pattern("*.spr");
         dialog.add_filter(filter);
 
-        if (dialog.run() == Gtk::RESPONSE_OK) {
-            auto image = load_spr_file(dialog.get_filename(), m_asset_root_dir);
-            if (image && !image->frames.empty()) {
-                drawing_area.images.push_back(image);
-                drawing_area.queue_draw();
-                start_animation_timer();  // if using a global animation timer
-            } else {
-                std::cerr << "No frames loaded from SPR file." << std::endl;
-            }
-        }
+        if (dialog.run() == Gtk::RESPONSE_OK)
+            add_file_with_undo(dialog.get_filename());
+    }
+
+    void add_file_with_undo(const fs::path& path) {
+        if (auto img = add_file(path))
+            record_edit({"Add", {{img, placement_of(*img), placement_of(*img), -1, drawing_area.z_of(img)}}});
     }
 
     void on_del_ele_clicked() {
         auto img = drawing_area.selected_image;
         if (!img) return;
+        ItemChange change{img, placement_of(*img), placement_of(*img), drawing_area.z_of(img), -1};
 		try {
-        drawing_area.images.erase(std::remove(drawing_area.images.begin(), drawing_area.images.end(), img), drawing_area.images.end());
+        drawing_area.remove_image(img);
+        record_edit({"Delete", {change}});
         } catch (...) {
             // Ignore invalid input
         }
@@ -278,15 +999,29 @@ public:
     void on_input_changed() {
         auto img = drawing_area.selected_image;
         if (!img) return;
+        ItemPlacement before = placement_of(*img);
+        try {
+            apply_inputs(img);
+        } catch (const std::exception&) {
+            std::cerr << "Invalid position or scale." << std::endl; // std::stod rejected the text
+            drawing_area.invalidate_item(img);
+        }
+        if (placement_of(*img) != before) {
+            ptrdiff_t z = drawing_area.z_of(img);
+            record_edit({"Edit Placement", {{img, before, placement_of(*img), z, z}}});
+        }
+    }
+
+    void apply_inputs(const std::shared_ptr<ImageItem>& img) {
             img->x = std::stod(x_entry.get_text());
             img->y = std::stod(y_entry.get_text());
 			if (std::stod(xscale_entry.get_text()) == 0){ 
-				img->scale_x = 0.1; return;}
+				img->scale_x = 0.1; drawing_area.invalidate_item(img); return;}
 			if (std::stod(yscale_entry.get_text()) == 0){ 
-				img->scale_y = 0.1; return;}
+				img->scale_y = 0.1; drawing_area.invalidate_item(img); return;}
            	img->scale_x = std::stod(xscale_entry.get_text());
            	img->scale_y = std::stod(yscale_entry.get_text());
-           	drawing_area.queue_draw();
+           	drawing_area.invalidate_item(img);
     }
 
     void on_image_selected() {
@@ -301,59 +1036,122 @@ public:
     void on_send_to_back() {
         auto img = drawing_area.selected_image;
         if (!img) return;
-        drawing_area.images.erase(std::remove(drawing_area.images.begin(), drawing_area.images.end(), img), drawing_area.images.end());
-        drawing_area.images.push_back(img);
-        drawing_area.queue_draw();
+        ptrdiff_t z = drawing_area.z_of(img);
+        drawing_area.restack_image(img, true);
+        record_edit({"Send to Back", {{img, placement_of(*img), placement_of(*img), z, drawing_area.z_of(img)}}});
 	std::cout << "Sending image to back" << std::endl;
     }
 
     void on_bring_to_front() {
         auto img = drawing_area.selected_image;
         if (!img) return;
-        drawing_area.images.erase(std::remove(drawing_area.images.begin(), drawing_area.images.end(), img), drawing_area.images.end());
-        drawing_area.images.insert(drawing_area.images.begin(), img);
-        drawing_area.queue_draw();
+        ptrdiff_t z = drawing_area.z_of(img);
+        drawing_area.restack_image(img, false);
+        record_edit({"Bring to Front", {{img, placement_of(*img), placement_of(*img), z, drawing_area.z_of(img)}}});
 	std::cout << "Bringing image to front" << std::endl;
     }
-};
 
-int main(int argc, char* argv[]) {
-    auto app = Gtk::Application::create(argc, argv, "org.example.imageeditor");
-    fs::path ASSET_ROOT_DIR;
-    const std::string CONFIG_FILE_NAME = "vs_anim.cfg";
+    // --- Undo/redo ---
+    void record_edit(EditCommand command) {
+        history.push(std::move(command));
+        update_history_actions();
+    }
+
+    void on_undo() {
+        if (const EditCommand* command = history.undo()) {
+            for (auto change = command->changes.rbegin(); change != command->changes.rend(); ++change)
+                apply_change(change->item, change->before, change->z_before);
+        }
+        update_history_actions();
+    }
 
-    std::ifstream config_file(CONFIG_FILE_NAME);
-    std::string root_dir_str;
+    void on_redo() {
+        if (const EditCommand* command = history.redo()) {
+            for (const auto& change : command->changes)
+                apply_change(change.item, change.after, change.z_after);
+        }
+        update_history_actions();
+    }
+
+    void apply_change(const std::shared_ptr<ImageItem>& img, const ItemPlacement& placement, ptrdiff_t z) {
+        apply_placement(*img, placement);
+        drawing_area.place_image(img, z);
+        if (img == drawing_area.selected_image)
+            on_image_selected();
+        if (z >= 0)
+            drawing_area.start_animation();
+    }
 
-    if (config_file.is_open()) {
-        if (std::getline(config_file, root_dir_str)) {
-            // Trim whitespace from the loaded string
-            root_dir_str.erase(0, root_dir_str.find_first_not_of(" \t\n\r\f\v"));
-            root_dir_str.erase(root_dir_str.find_last_not_of(" \t\n\r\f\v") + 1);
+    void update_history_actions() {
+        item_undo->set_sensitive(history.can_undo());
+        item_redo->set_sensitive(history.can_redo());
+        item_undo->set_label(history.can_undo() ? "_Undo " + history.undo_label() + " (Ctrl+Z)" : "_Undo (Ctrl+Z)");
+        item_redo->set_label(history.can_redo() ? "_Redo " + history.redo_label() + " (Ctrl+Y)" : "_Redo (Ctrl+Y)");
+    }
 
-            if (!root_dir_str.empty()) {
-                ASSET_ROOT_DIR = root_dir_str;
-                std::cout << "Loaded ASSET_ROOT_DIR from " << CONFIG_FILE_NAME << ": " << ASSET_ROOT_DIR << std::endl;
-            } else {
-                std::cerr << "Error: " << CONFIG_FILE_NAME << " is empty or contains only whitespace. Using default ASSET_ROOT_DIR." << std::endl;
-                ASSET_ROOT_DIR = "/home/james/Project/WCUniverse/"; // Default fallback
+    bool on_key_press_event(GdkEventKey* event) override {
+        if (event->state & GDK_CONTROL_MASK) {
+            bool shift = event->state & GDK_SHIFT_MASK;
+            if ((event->keyval == GDK_KEY_z || event->keyval == GDK_KEY_Z) && !shift) {
+                on_undo();
+                return true;
+            }
+            if (event->keyval == GDK_KEY_y || event->keyval == GDK_KEY_Y ||
+                ((event->keyval == GDK_KEY_z || event->keyval == GDK_KEY_Z) && shift)) {
+                on_redo();
+                return true;
             }
-        } else {
-            std::cerr << "Error: Could not read from " << CONFIG_FILE_NAME << ". Using default ASSET_ROOT_DIR." << std::endl;
-            ASSET_ROOT_DIR = "/home/james/Project/WCUniverse/"; // Default fallback
         }
-        config_file.close();
-    } else {
-        std::cerr << "Error: Could not open " << CONFIG_FILE_NAME << ". Using default ASSET_ROOT_DIR." << std::endl;
-        ASSET_ROOT_DIR = "/home/james/Project/WCUniverse/"; // Default fallback
+        return Gtk::Window::on_key_press_event(event);
     }
+};
 
-    // Ensure the ASSET_ROOT_DIR exists and is a directory (optional, but good for robust error checking)
-    if (!fs::is_directory(ASSET_ROOT_DIR)) {
-        std::cerr << "Warning: ASSET_ROOT_DIR '" << ASSET_ROOT_DIR << "' is not a valid directory. Paths might fail." << std::endl;
-        // You might want to exit here if it's critical for your application
-        // return 1;
+int main(int argc, char* argv[]) {
+    // Editor options are taken out of argv before GApplication sees it:
+    //   --trace FILE        record timings for the whole session as Chrome trace-event JSON
+    //   --frame-budget MIB  decoded pixels kept for long animations (and unused cached images)
+    //   --lazy-frames N     animations with more frames than this decode on demand
+    auto take_option = [&](const std::string& name) -> std::string {
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (argv[i] == name) {
+                std::string value = argv[i + 1];
+                for (int j = i; j + 2 <= argc; ++j)
+                    argv[j] = argv[j + 2];
+                argc -= 2;
+                return value;
+            }
+        }
+        return {};
+    };
+    fs::path trace_path = take_option("--trace");
+    if (!trace_path.empty())
+        perf::Recorder::instance().start_trace();
+    std::string frame_budget = take_option("--frame-budget");
+    if (!frame_budget.empty()) {
+        long mib = std::atol(frame_budget.c_str());
+        if (mib > 0)
+            FrameBudget::instance().budget_bytes = static_cast<size_t>(mib) << 20;
+        else
+            std::cerr << "Warning: ignoring --frame-budget " << frame_budget << "; expected a size in MiB" << std::endl;
     }
+    std::string lazy_frames = take_option("--lazy-frames");
+    if (!lazy_frames.empty())
+        FrameBudget::instance().lazy_threshold_frames = static_cast<size_t>(std::max(0L, std::atol(lazy_frames.c_str())));
+
+    auto app = Gtk::Application::create(argc, argv, "org.example.imageeditor");
+    fs::path ASSET_ROOT_DIR = read_asset_root_dir();
+
+    // Keep unreferenced source images around only up to the lazy frame budget, so frames a
+    // LazyFrameStore evicts actually release their pixels
+    ImageCache::instance().set_memory_cap(FrameBudget::instance().budget_bytes);
+
     MainWindow window(ASSET_ROOT_DIR);
-    return app->run(window);
+    int status = app->run(window);
+    if (!trace_path.empty()) {
+        if (perf::Recorder::instance().write_trace(trace_path))
+            std::cout << "Wrote " << perf::Recorder::instance().event_count() << " trace events to " << trace_path << std::endl;
+        else
+            std::cerr << "Error: could not write trace to " << trace_path << std::endl;
+    }
+    return status;
 }
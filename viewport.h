@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include "image_item.h"
+
+// View transform of the canvas: widget = widget centre + pan + canvas * zoom, where canvas
+// coordinates are the ones items store (origin at the canvas centre). Drawing, damage and pointer
+// handling all convert through here so they can't disagree.
+struct Viewport {
+    static constexpr double min_zoom = 1.0 / 64, max_zoom = 64;
+
+    double zoom = 1.0;
+    double pan_x = 0, pan_y = 0;   // widget pixels, kept whole so 1:1 frames stay pixel-aligned
+    double width = 0, height = 0;  // widget size
+
+    void to_canvas(double wx, double wy, double& cx, double& cy) const {
+        cx = (wx - width / 2.0 - pan_x) / zoom;
+        cy = (wy - height / 2.0 - pan_y) / zoom;
+    }
+
+    void to_widget(double cx, double cy, double& wx, double& wy) const {
+        wx = width / 2.0 + pan_x + cx * zoom;
+        wy = height / 2.0 + pan_y + cy * zoom;
+    }
+
+    // Sets up cr so that user space is canvas space
+    void apply(const Cairo::RefPtr<Cairo::Context>& cr) const {
+        cr->translate(width / 2.0 + pan_x, height / 2.0 + pan_y);
+        if (zoom != 1.0)
+            cr->scale(zoom, zoom);
+    }
+
+    // Canvas-space box currently on screen
+    ItemBounds visible_canvas() const {
+        double x1, y1, x2, y2;
+        to_canvas(0, 0, x1, y1);
+        to_canvas(width, height, x2, y2);
+        return {x1, y1, x2 - x1, y2 - y1};
+    }
+
+    // Changes the zoom by `factor`, keeping the canvas point under widget position (wx, wy) in place
+    void zoom_at(double factor, double wx, double wy) {
+        double cx, cy;
+        to_canvas(wx, wy, cx, cy);
+        zoom = std::clamp(zoom * factor, min_zoom, max_zoom);
+        if (std::abs(zoom - 1.0) < 1e-6)
+            zoom = 1.0; // stepping back to 100% must land exactly on the unscaled draw path
+        pan_x = std::round(wx - width / 2.0 - cx * zoom);
+        pan_y = std::round(wy - height / 2.0 - cy * zoom);
+    }
+
+    void pan_by(double dx, double dy) {
+        pan_x = std::round(pan_x + dx);
+        pan_y = std::round(pan_y + dy);
+    }
+
+    void reset() {
+        zoom = 1.0;
+        pan_x = pan_y = 0;
+    }
+
+    // Centres `scene` and zooms so it fills the widget, less a margin in pixels
+    void fit(const ItemBounds& scene, double margin = 16) {
+        if (scene.empty() || width <= 2 * margin || height <= 2 * margin) {
+            reset();
+            return;
+        }
+        zoom = std::clamp(std::min((width - 2 * margin) / scene.width, (height - 2 * margin) / scene.height),
+                          min_zoom, max_zoom);
+        pan_x = std::round(-(scene.left + scene.width / 2.0) * zoom);
+        pan_y = std::round(-(scene.top + scene.height / 2.0) * zoom);
+    }
+};